@@ -0,0 +1,447 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Benchmarks
+//! Latency and throughput of the hot paths on stable Rust, using only
+//! `std::time`. Run with `cargo bench --bench bench [-- <filter>...]`, where
+//! each filter selects the benchmarks whose name contains it. The target
+//! time per benchmark is `SECP256K1_BENCH_MS` milliseconds (default 500).
+//!
+//! Every line reports one benchmark as `name/batch=N[/threads=T]`, the time
+//! per item and the items per second; for a batch API one item is one
+//! element of the batch, so the numbers compare directly with the
+//! single-item calls.
+
+extern crate rand;
+extern crate secp256k1;
+
+use std::{env, mem, ptr};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use rand::{RngCore, thread_rng};
+use secp256k1::{Secp256k1, Message, Signature, RecoverableSignature, ContextFlag, Error};
+use secp256k1::key::{PublicKey, SecretKey, Compressed, Uncompressed};
+use secp256k1::ecdh::{SharedSecret, PrecomputedPoint};
+use secp256k1::batch::PublicKeyBatch;
+use secp256k1::keyfile::{self, KeySet};
+use secp256k1::pool::{ContextPool, PoolConfig};
+use secp256k1::session::SigningSession;
+use secp256k1::cache::{RecoverCache, SigCache};
+
+/// Batch sizes for the batch APIs
+const BATCH_SIZES: &'static [usize] = &[1, 16, 64, 256, 1024];
+
+/// Keeps the optimizer from discarding `x` or the computation behind it
+#[inline(never)]
+fn black_box<T>(x: T) -> T {
+    unsafe {
+        let ret = ptr::read_volatile(&x);
+        mem::forget(x);
+        ret
+    }
+}
+
+struct Bencher {
+    filters: Vec<String>,
+    target: Duration
+}
+
+impl Bencher {
+    fn from_env() -> Bencher {
+        // cargo passes `--bench`; everything else is a name filter
+        let filters = env::args().skip(1).filter(|arg| !arg.starts_with("--")).collect();
+        let ms = env::var("SECP256K1_BENCH_MS").ok().and_then(|ms| ms.parse().ok()).unwrap_or(500);
+        Bencher {
+            filters: filters,
+            target: Duration::from_millis(ms)
+        }
+    }
+
+    fn enabled(&self, name: &str) -> bool {
+        self.filters.is_empty() || self.filters.iter().any(|f| name.contains(&f[..]))
+    }
+
+    /// Times `f`, which processes `items` items per call
+    fn run<F: FnMut()>(&self, name: &str, items: usize, mut f: F) {
+        if !self.enabled(name) {
+            return;
+        }
+        // Warm up and estimate the number of calls that fill the target time
+        let start = Instant::now();
+        let mut calls = 0u64;
+        while calls == 0 || start.elapsed() < self.target / 10 {
+            f();
+            calls += 1;
+        }
+        let per_call = start.elapsed() / calls as u32;
+        let calls = (self.target.as_nanos() / per_call.as_nanos().max(1)).max(1) as u64;
+
+        let start = Instant::now();
+        for _ in 0..calls {
+            f();
+        }
+        let elapsed = start.elapsed();
+
+        let total = calls as f64 * items as f64;
+        let ns = elapsed.as_secs() as f64 * 1e9 + elapsed.subsec_nanos() as f64;
+        println!("{:<48} {:>12.1} ns/item {:>12.0} items/s", name, ns / total, total * 1e9 / ns);
+    }
+}
+
+fn random_message() -> Message {
+    let mut msg = [0u8; 32];
+    thread_rng().fill_bytes(&mut msg);
+    Message::from_slice(&msg).unwrap()
+}
+
+fn recoverable_inputs(s: &Secp256k1, n: usize) -> Vec<(Message, RecoverableSignature, PublicKey)> {
+    (0..n).map(|_| {
+        let msg = random_message();
+        let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+        (msg, s.sign_recoverable(&msg, &sk).unwrap(), pk)
+    }).collect()
+}
+
+fn context(b: &Bencher) {
+    b.run("context/create", 1, || { black_box(Secp256k1::new()); });
+    b.run("context/create_sign_only", 1, || { black_box(Secp256k1::with_caps(ContextFlag::SignOnly)); });
+    b.run("context/global", 1, || { black_box(Secp256k1::global()); });
+    b.run("context/create_static_verify_only", 1, || {
+        black_box(Secp256k1::with_caps_static(ContextFlag::VerifyOnly));
+    });
+    let s = Secp256k1::new();
+    b.run("context/clone", 1, || { black_box(s.clone()); });
+    let mut s = Secp256k1::new();
+    b.run("context/randomize", 1, || s.randomize(&mut thread_rng()));
+    // One use of a thread's pooled context, rerandomized on the default schedule
+    let pool = ContextPool::new(PoolConfig::default());
+    b.run("context/pool_with", 1, || { black_box(pool.with(|secp| secp as *const Secp256k1 as usize)); });
+}
+
+fn keys(b: &Bencher) {
+    let s = Secp256k1::new();
+    let sk = SecretKey::new(&s, &mut thread_rng());
+    let tweak = SecretKey::new(&s, &mut thread_rng());
+    let pk = PublicKey::from_secret_key(&s, &sk).unwrap();
+
+    b.run("key/secret_key_new", 1, || { black_box(SecretKey::new(&s, &mut thread_rng())); });
+    b.run("key/from_secret_key", 1, || { black_box(PublicKey::from_secret_key(&s, &sk).unwrap()); });
+    for &n in BATCH_SIZES {
+        let sks: Vec<_> = (0..n).map(|_| SecretKey::new(&s, &mut thread_rng())).collect();
+        let mut out = vec![PublicKey::new(); n];
+        b.run(&format!("key/from_secret_keys/batch={}", n), n, || {
+            PublicKey::from_secret_keys(&s, &sks, &mut out).unwrap();
+            black_box(&out);
+        });
+    }
+
+    b.run("key/secret_tweak_add", 1, || {
+        let mut k = sk;
+        k.add_assign(&s, &tweak).unwrap();
+        black_box(k);
+    });
+    b.run("key/secret_tweak_mul", 1, || {
+        let mut k = sk;
+        k.mul_assign(&s, &tweak).unwrap();
+        black_box(k);
+    });
+    b.run("key/secret_inverse", 1, || {
+        let mut k = sk;
+        k.inv_assign(&s).unwrap();
+        black_box(k);
+    });
+    for &n in BATCH_SIZES {
+        let keys: Vec<_> = (0..n).map(|_| SecretKey::new(&s, &mut thread_rng())).collect();
+        let mut out = keys.clone();
+        b.run(&format!("key/secret_inverse/batch={}", n), n, || {
+            out.copy_from_slice(&keys);
+            SecretKey::inv_batch(&s, &mut out).unwrap();
+            black_box(&out);
+        });
+    }
+    b.run("key/public_tweak_add", 1, || {
+        let mut p = pk;
+        p.add_exp_assign(&s, &tweak).unwrap();
+        black_box(p);
+    });
+    b.run("key/public_tweak_mul", 1, || {
+        let mut p = pk;
+        p.mul_assign(&s, &tweak).unwrap();
+        black_box(p);
+    });
+    let other = PublicKey::from_secret_key(&s, &tweak).unwrap();
+    b.run("key/public_add", 1, || {
+        let mut p = pk;
+        p.add_assign(&s, &other).unwrap();
+        black_box(p);
+    });
+    b.run("key/public_tweak_mul_vartime", 1, || {
+        let mut p = pk;
+        p.mul_assign_vartime(&s, &tweak).unwrap();
+        black_box(p);
+    });
+    b.run("key/public_add_vartime", 1, || {
+        let mut p = pk;
+        p.add_assign_vartime(&s, &other).unwrap();
+        black_box(p);
+    });
+}
+
+fn serialization(b: &Bencher) {
+    let s = Secp256k1::new();
+    let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+    let msg = random_message();
+
+    let compressed = pk.serialize_vec(&s, true);
+    let uncompressed = pk.serialize_vec(&s, false);
+    b.run("pubkey/parse_compressed", 1, || { black_box(PublicKey::from_slice(&s, &compressed).unwrap()); });
+    b.run("pubkey/parse_uncompressed", 1, || { black_box(PublicKey::from_slice(&s, &uncompressed).unwrap()); });
+    b.run("pubkey/serialize_vec", 1, || { black_box(pk.serialize_vec(&s, false)); });
+    let mut out = [0; 65];
+    b.run("pubkey/serialize_into", 1, || {
+        pk.serialize_into(&s, &mut out);
+        black_box(&out);
+    });
+    for &n in BATCH_SIZES {
+        let keys = vec![pk; n];
+        let mut out33 = vec![0; 33 * n];
+        let mut out65 = vec![0; 65 * n];
+        b.run(&format!("pubkey/serialize_batch_compressed/batch={}", n), n, || {
+            PublicKey::serialize_batch::<Compressed>(&s, &keys, &mut out33).unwrap();
+            black_box(&out33);
+        });
+        b.run(&format!("pubkey/serialize_batch_uncompressed/batch={}", n), n, || {
+            PublicKey::serialize_batch::<Uncompressed>(&s, &keys, &mut out65).unwrap();
+            black_box(&out65);
+        });
+    }
+
+    for &n in BATCH_SIZES {
+        let keys: Vec<_> = (0..n).map(|_| s.generate_keypair(&mut thread_rng()).unwrap().1).collect();
+        let batch = PublicKeyBatch::from_keys(&keys);
+        let mut out33 = vec![0; 33 * n];
+        b.run(&format!("pubkey_batch/serialize_compressed/batch={}", n), n, || {
+            batch.serialize::<Compressed>(&s, &mut out33).unwrap();
+            black_box(&out33);
+        });
+        b.run(&format!("pubkey_batch/combine_vartime/batch={}", n), n, || {
+            black_box(batch.combine_vartime(&s).unwrap());
+        });
+        b.run(&format!("pubkey/combine_vartime/batch={}", n), n, || {
+            black_box(PublicKey::combine_vartime(&s, &keys).unwrap());
+        });
+        b.run(&format!("pubkey_batch/position_x/batch={}", n), n, || {
+            black_box(batch.position_x(&pk));
+        });
+    }
+
+    for &n in BATCH_SIZES {
+        let keys: Vec<_> = (0..n).map(|_| s.generate_keypair(&mut thread_rng()).unwrap().1).collect();
+        let mut file = Vec::new();
+        keyfile::write(&s, &mut file, &keys).unwrap();
+        b.run(&format!("keyfile/open/batch={}", n), n, || {
+            black_box(KeySet::from_bytes(&s, &file).unwrap());
+        });
+        b.run(&format!("keyfile/open_check_all/batch={}", n), n, || {
+            KeySet::from_bytes(&s, &file).unwrap().check_all(&s).unwrap();
+        });
+    }
+
+    let sig = s.sign(&msg, &sk).unwrap();
+    let der = sig.serialize_der(&s);
+    b.run("signature/parse_der", 1, || { black_box(Signature::from_der(&s, &der).unwrap()); });
+    b.run("signature/parse_der_lax", 1, || { black_box(Signature::from_der_lax(&s, &der).unwrap()); });
+    b.run("signature/serialize_der", 1, || { black_box(sig.serialize_der(&s)); });
+
+    let rsig = s.sign_recoverable(&msg, &sk).unwrap();
+    let (recid, compact) = rsig.serialize_compact(&s);
+    b.run("signature/parse_compact", 1, || {
+        black_box(RecoverableSignature::from_compact(&s, &compact, recid).unwrap());
+    });
+    b.run("signature/serialize_compact", 1, || { black_box(rsig.serialize_compact(&s)); });
+
+    for &n in BATCH_SIZES {
+        let mut ders = vec![];
+        let mut der_offsets = vec![0];
+        let mut rsvs = vec![];
+        for _ in 0..n {
+            let sig = s.sign_recoverable(&random_message(), &sk).unwrap();
+            ders.extend_from_slice(&sig.to_standard(&s).serialize_der(&s));
+            der_offsets.push(ders.len());
+            let (recid, compact) = sig.serialize_compact(&s);
+            rsvs.extend_from_slice(&compact);
+            rsvs.push(recid.to_i32() as u8);
+        }
+        let rsv_offsets: Vec<_> = (0..n).map(|i| 65 * i).collect();
+        let mut sigs = vec![Err(Error::InvalidSignature); n];
+        let mut rsigs = vec![Err(Error::InvalidSignature); n];
+        b.run(&format!("signature/parse_der_batch/batch={}", n), n, || {
+            Signature::from_der_batch(&s, &ders, &der_offsets, &mut sigs);
+            black_box(&sigs);
+        });
+        b.run(&format!("signature/parse_der_lax_batch/batch={}", n), n, || {
+            Signature::from_der_lax_batch(&s, &ders, &der_offsets, &mut sigs);
+            black_box(&sigs);
+        });
+        b.run(&format!("signature/parse_rsv_batch/batch={}", n), n, || {
+            RecoverableSignature::from_rsv_batch(&s, &rsvs, &rsv_offsets, &mut rsigs);
+            black_box(&rsigs);
+        });
+        b.run(&format!("signature/parse_rsv_batch_strict/batch={}", n), n, || {
+            RecoverableSignature::from_rsv_batch_strict(&s, &rsvs, &rsv_offsets, &mut rsigs);
+            black_box(&rsigs);
+        });
+    }
+}
+
+fn ecdsa(b: &Bencher) {
+    let s = Secp256k1::new();
+    let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+    let msg = random_message();
+    let sig = s.sign(&msg, &sk).unwrap();
+    let rsig = s.sign_recoverable(&msg, &sk).unwrap();
+
+    b.run("ecdsa/sign", 1, || { black_box(s.sign(&msg, &sk).unwrap()); });
+    b.run("ecdsa/sign_recoverable", 1, || { black_box(s.sign_recoverable(&msg, &sk).unwrap()); });
+    let session = SigningSession::new(&s, &sk).unwrap();
+    b.run("ecdsa/session_sign", 1, || { black_box(session.sign(&msg)); });
+    for &n in BATCH_SIZES {
+        let msgs: Vec<_> = (0..n).map(|_| random_message()).collect();
+        b.run(&format!("ecdsa/session_sign/batch={}", n), n, || { black_box(session.sign_batch(&msgs)); });
+    }
+    b.run("ecdsa/verify", 1, || { black_box(s.verify(&msg, &sig, &pk).unwrap()); });
+    b.run("ecdsa/recover", 1, || { black_box(s.recover(&msg, &rsig).unwrap()); });
+    let mut cached = s.clone();
+    cached.set_recover_cache(Some(Arc::new(RecoverCache::new(1024))));
+    cached.recover(&msg, &rsig).unwrap();
+    b.run("ecdsa/recover_cached", 1, || { black_box(cached.recover(&msg, &rsig).unwrap()); });
+    cached.set_sig_cache(Some(Arc::new(SigCache::new(1 << 20))));
+    cached.verify(&msg, &sig, &pk).unwrap();
+    b.run("ecdsa/verify_cached", 1, || { black_box(cached.verify(&msg, &sig, &pk).unwrap()); });
+    b.run("ecdsa/recover_address", 1, || { black_box(s.recover_address(&msg, &rsig).unwrap()); });
+
+    for &n in BATCH_SIZES {
+        let triples = recoverable_inputs(&s, n);
+        let pairs: Vec<_> = triples.iter().map(|&(msg, sig, _)| (msg, sig)).collect();
+        let mut keys = vec![Err(Error::InvalidSignature); n];
+        let mut addresses = vec![Err(Error::InvalidSignature); n];
+        let mut results = vec![Ok(()); n];
+
+        b.run(&format!("ecdsa/recover_batch/batch={}", n), n, || {
+            s.recover_batch(&pairs, &mut keys).unwrap();
+            black_box(&keys);
+        });
+        b.run(&format!("ecdsa/recover_address_batch/batch={}", n), n, || {
+            s.recover_address_batch(&pairs, &mut addresses).unwrap();
+            black_box(&addresses);
+        });
+        b.run(&format!("ecdsa/verify_batch/batch={}", n), n, || {
+            black_box(s.verify_batch(&triples).unwrap());
+        });
+        b.run(&format!("ecdsa/verify_batch_each/batch={}", n), n, || {
+            s.verify_batch_each(&triples, &mut results).unwrap();
+            black_box(&results);
+        });
+    }
+}
+
+#[cfg(feature = "parallel")]
+fn parallel(b: &Bencher) {
+    use std::thread;
+
+    const N: usize = 4096;
+    let s = Secp256k1::new();
+    let cores = thread::available_parallelism().map(|n| n.get()).unwrap_or(1);
+    let mut threads = vec![1, 2, 4, 8];
+    threads.retain(|&t| t < cores);
+    threads.push(cores);
+
+    let triples = recoverable_inputs(&s, N);
+    let pairs: Vec<_> = triples.iter().map(|&(msg, sig, _)| (msg, sig)).collect();
+    let plain: Vec<_> = triples.iter().map(|&(msg, sig, pk)| (msg, sig.to_standard(&s), pk)).collect();
+    let mut keys = vec![Err(Error::InvalidSignature); N];
+    let mut results = vec![Ok(()); N];
+
+    for &t in &threads {
+        b.run(&format!("parallel/par_recover/batch={}/threads={}", N, t), N, || {
+            s.par_recover(t, &pairs, &mut keys).unwrap();
+            black_box(&keys);
+        });
+        b.run(&format!("parallel/par_verify/batch={}/threads={}", N, t), N, || {
+            s.par_verify(t, &plain, &mut results).unwrap();
+            black_box(&results);
+        });
+    }
+}
+
+#[cfg(not(feature = "parallel"))]
+fn parallel(_: &Bencher) {}
+
+#[cfg(feature = "service")]
+fn service(b: &Bencher) {
+    use secp256k1::service::{VerifyService, ServiceConfig};
+
+    const N: usize = 4096;
+    let s = Secp256k1::new();
+    let triples = recoverable_inputs(&s, N);
+    let service = VerifyService::new(s.clone(), ServiceConfig::default());
+
+    // Requests submitted one by one, as from many tasks, and coalesced
+    b.run(&format!("service/verify_recoverable/requests={}", N), N, || {
+        let responses: Vec<_> = triples.iter().map(|&(msg, sig, pk)| service.verify_recoverable(msg, sig, pk)).collect();
+        for response in responses {
+            black_box(response.wait().unwrap());
+        }
+    });
+    b.run(&format!("service/recover/requests={}", N), N, || {
+        let responses: Vec<_> = triples.iter().map(|&(msg, sig, _)| service.recover(msg, sig)).collect();
+        for response in responses {
+            black_box(response.wait().unwrap());
+        }
+    });
+}
+
+#[cfg(not(feature = "service"))]
+fn service(_: &Bencher) {}
+
+fn ecdh(b: &Bencher) {
+    let s = Secp256k1::new();
+    let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+    let (_, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+
+    b.run("ecdh/new", 1, || { black_box(SharedSecret::new(&s, &pk, &sk)); });
+    b.run("ecdh/new_raw", 1, || { black_box(SharedSecret::new_raw(&s, &pk, &sk)); });
+    for &n in BATCH_SIZES {
+        let input: Vec<_> = (0..n).map(|_| (pk, SecretKey::new(&s, &mut thread_rng()))).collect();
+        let mut out = vec![SharedSecret::new_raw(&s, &pk, &sk); n];
+        b.run(&format!("ecdh/new_raw_batch/batch={}", n), n, || {
+            SharedSecret::new_raw_batch(&s, &input, &mut out).unwrap();
+            black_box(&out);
+        });
+    }
+    b.run("ecdh/precomputed_point_new", 1, || { black_box(PrecomputedPoint::new(&s, &pk).unwrap()); });
+    let point = PrecomputedPoint::new(&s, &pk).unwrap();
+    b.run("ecdh/with_precomputed", 1, || { black_box(SharedSecret::with_precomputed(&s, &point, &sk)); });
+    b.run("ecdh/with_precomputed_raw", 1, || { black_box(SharedSecret::with_precomputed_raw(&s, &point, &sk)); });
+}
+
+fn main() {
+    let b = Bencher::from_env();
+    context(&b);
+    keys(&b);
+    serialization(&b);
+    ecdsa(&b);
+    ecdh(&b);
+    parallel(&b);
+    service(&b);
+}
@@ -28,7 +28,9 @@ extern crate cc;
 
 use std::env;
 use std::ffi::OsString;
-use std::path::PathBuf;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::process::Command;
 
 cfg_if! {
 	if #[cfg(target_os = "macos")] {
@@ -43,6 +45,119 @@ cfg_if! {
 	}
 }
 
+/// Sizes of the precomputed tables; see the README for the memory cost of
+/// each setting.
+struct TableConfig {
+	/// `ECMULT_WINDOW_SIZE`, used by verification and recovery. Allowed
+	/// values are 2..24, there is a tradeoff between memory and cpu time
+	ecmult_window_size: u32,
+	/// `ECMULT_GEN_PREC_BITS`, used by signing and key generation. Allowed
+	/// values are: 2, 4, and 8
+	ecmult_gen_prec_bits: u32,
+}
+
+impl TableConfig {
+	/// Picks the table sizes from, in order of precedence, the
+	/// `SECP256K1_ECMULT_WINDOW_SIZE` and `SECP256K1_ECMULT_GEN_PREC_BITS`
+	/// environment variables, the `highmem` and `lowmem` features (`highmem`
+	/// wins if both are enabled somewhere in the dependency graph), and the
+	/// defaults: smallest tables on Android, tuned for best ratio elsewhere.
+	fn from_env(target: &str) -> TableConfig {
+		let (window, gen) = if env::var_os("CARGO_FEATURE_HIGHMEM").is_some() {
+			(15, 8)
+		} else if env::var_os("CARGO_FEATURE_LOWMEM").is_some() || target.contains("android") {
+			(2, 2)
+		} else {
+			(8, 4)
+		};
+
+		let config = TableConfig {
+			ecmult_window_size: env_u32("SECP256K1_ECMULT_WINDOW_SIZE").unwrap_or(window),
+			ecmult_gen_prec_bits: env_u32("SECP256K1_ECMULT_GEN_PREC_BITS").unwrap_or(gen),
+		};
+		assert!(config.ecmult_window_size >= 2 && config.ecmult_window_size <= 24,
+			"SECP256K1_ECMULT_WINDOW_SIZE must be in the range 2..24");
+		assert!([2, 4, 8].contains(&config.ecmult_gen_prec_bits),
+			"SECP256K1_ECMULT_GEN_PREC_BITS must be 2, 4 or 8");
+		config
+	}
+}
+
+fn env_u32(name: &str) -> Option<u32> {
+	println!("cargo:rerun-if-env-changed={}", name);
+	env::var(name).ok().map(|value| value.trim().parse()
+		.unwrap_or_else(|_| panic!("{} must be a number, got {:?}", name, value)))
+}
+
+fn env_string(name: &str) -> Option<String> {
+	println!("cargo:rerun-if-env-changed={}", name);
+	env::var(name).ok().map(|value| value.trim().to_owned()).filter(|value| !value.is_empty())
+}
+
+/// Code generation settings for the C library on top of the flags `cc`
+/// derives from the cargo profile; see "Performance builds" in the README.
+struct CodegenConfig {
+	/// `SECP256K1_OPT_LEVEL`: optimization level (`0`..`3`, `s`, `z`),
+	/// independent of the cargo profile's `opt-level`
+	opt_level: Option<String>,
+	/// `SECP256K1_TARGET_CPU`: CPU to tune for and whose instructions may be
+	/// used, `native` for the build machine
+	target_cpu: Option<String>,
+	/// `SECP256K1_LTO`: emit LLVM bitcode for cross-language LTO (Clang only)
+	lto: bool,
+	/// `SECP256K1_PGO_GENERATE`: directory for instrumentation profiles
+	pgo_generate: Option<String>,
+	/// `SECP256K1_PGO_USE`: merged `.profdata` file to optimize with
+	pgo_use: Option<String>,
+}
+
+impl CodegenConfig {
+	fn from_env() -> CodegenConfig {
+		let config = CodegenConfig {
+			opt_level: env_string("SECP256K1_OPT_LEVEL"),
+			target_cpu: env_string("SECP256K1_TARGET_CPU"),
+			lto: env_string("SECP256K1_LTO").map_or(false, |value| value != "0"),
+			pgo_generate: env_string("SECP256K1_PGO_GENERATE"),
+			pgo_use: env_string("SECP256K1_PGO_USE"),
+		};
+		if let Some(ref level) = config.opt_level {
+			assert!(["0", "1", "2", "3", "s", "z"].contains(&level.as_str()),
+				"SECP256K1_OPT_LEVEL must be 0, 1, 2, 3, s or z");
+		}
+		assert!(config.pgo_generate.is_none() || config.pgo_use.is_none(),
+			"SECP256K1_PGO_GENERATE and SECP256K1_PGO_USE are mutually exclusive");
+		config
+	}
+
+	fn apply(&self, config: &mut cc::Build, arch: &str) {
+		if let Some(ref level) = self.opt_level {
+			config.opt_level_str(level);
+		}
+		if let Some(ref cpu) = self.target_cpu {
+			// GCC and Clang only accept -march on x86, and -mcpu on ARM
+			let flag = if arch == "x86_64" || arch == "x86" { "-march" } else { "-mcpu" };
+			config.flag(&format!("{}={}", flag, cpu));
+		}
+
+		let clang = config.get_compiler().is_like_clang();
+		if self.lto {
+			assert!(clang, "SECP256K1_LTO needs Clang, set CC=clang");
+			config.flag("-flto=thin");
+		}
+		if let Some(ref dir) = self.pgo_generate {
+			config.flag(&format!("-fprofile-generate={}", dir));
+		}
+		if let Some(ref file) = self.pgo_use {
+			println!("cargo:rerun-if-changed={}", file);
+			config.flag(&format!("-fprofile-use={}", file));
+			if clang {
+				// Functions without profile data are not an error
+				config.flag("-Wno-profile-instr-unprofiled");
+			}
+		}
+	}
+}
+
 const ANDROID_INCLUDE: &'static str = "platforms/android-21/arch-arm64/usr/include";
 
 fn android_aarch_compiler() -> String {
@@ -78,7 +193,91 @@ fn setup_android(config: &mut cc::Build) {
 	config.include(&concat_paths(&ndk_home, ANDROID_INCLUDE));
 }
 
+fn manifest_path(path: &str) -> PathBuf {
+	let dir = env::var("CARGO_MANIFEST_DIR").expect("CARGO_MANIFEST_DIR env variable is set by cargo; qed");
+	concat_paths(&dir, path)
+}
+
+/// Compiles a standalone C program for the build host (not the target, which
+/// may be a cross-compilation target) and returns the path of the executable.
+fn build_host_tool(name: &str, source: &str, defines: &[(&str, &str)], out_dir: &Path) -> PathBuf {
+	let host = env::var("HOST").expect("HOST env variable is set by cargo; qed");
+	let compiler = cc::Build::new()
+		.host(&host)
+		.target(&host)
+		.opt_level(2)
+		.cargo_metadata(false)
+		.get_compiler();
+	let msvc = compiler.is_like_msvc();
+	let exe = out_dir.join(if host.contains("windows") { format!("{}.exe", name) } else { name.to_owned() });
+
+	let mut cmd = compiler.to_command();
+	for dir in &["depend/secp256k1", "depend/secp256k1/src", "depend/secp256k1/include"] {
+		cmd.arg(format!("{}{}", if msvc { "/I" } else { "-I" }, manifest_path(dir).display()));
+	}
+	for &(key, value) in defines {
+		cmd.arg(format!("{}{}={}", if msvc { "/D" } else { "-D" }, key, value));
+	}
+	cmd.arg(manifest_path(source)).current_dir(out_dir);
+	if msvc {
+		cmd.arg(format!("/Fe{}", exe.display()));
+	} else {
+		cmd.arg("-o").arg(&exe);
+	}
+	let status = cmd.status().expect("failed to run the host C compiler");
+	assert!(status.success(), "failed to compile {} for the host", source);
+	exe
+}
+
+fn run_host_tool(cmd: &mut Command) {
+	let status = cmd.status().expect("failed to run a host build tool");
+	assert!(status.success(), "{:?} failed", cmd);
+}
+
+/// Generates the precomputed signing and verification tables at build time so
+/// that they can be compiled into the library as read-only data. Returns the
+/// directory containing the generated headers.
+fn generate_static_tables(out_dir: &Path, window_size: &str, gen_prec_bits: &str) -> PathBuf {
+	let defines = [
+		("ECMULT_WINDOW_SIZE", window_size),
+		("ECMULT_GEN_PREC_BITS", gen_prec_bits),
+	];
+	// The tables are hardware independent, so the generators are always
+	// built with the portable field and scalar implementations
+	let ecmult_defines = [
+		("ECMULT_WINDOW_SIZE", window_size),
+		("USE_NUM_NONE", "1"),
+		("USE_FIELD_INV_BUILTIN", "1"),
+		("USE_SCALAR_INV_BUILTIN", "1"),
+		("USE_FIELD_10X26", "1"),
+		("USE_SCALAR_8X32", "1"),
+		("USE_ENDOMORPHISM", "1"),
+	];
+
+	// gen_context writes src/ecmult_static_context.h relative to its working directory
+	let gen_dir = out_dir.join("gen");
+	fs::create_dir_all(gen_dir.join("src")).expect("failed to create the table output directory");
+
+	let gen_context = build_host_tool("gen_context", "depend/secp256k1/src/gen_context.c", &defines, out_dir);
+	run_host_tool(Command::new(&gen_context).current_dir(&gen_dir));
+
+	let gen_ecmult = build_host_tool("gen_ecmult_static", "depend/gen_ecmult_static.c", &ecmult_defines, out_dir);
+	run_host_tool(Command::new(&gen_ecmult).arg(gen_dir.join("src/ext_ecmult_static_context.h")));
+
+	gen_dir.join("src")
+}
+
 fn main() {
+	// Emitting any rerun-if directive disables cargo's default of rerunning
+	// on every change in the package
+	println!("cargo:rerun-if-changed=build.rs");
+	println!("cargo:rerun-if-changed=depend");
+
+	let target = env::var("TARGET").expect("TARGET env variable is set by cargo; qed");
+	let tables = TableConfig::from_env(&target);
+	let window_size = tables.ecmult_window_size.to_string();
+	let gen_prec_bits = tables.ecmult_gen_prec_bits.to_string();
+
 	// Check whether we can use 64-bit compilation
 	let use_64bit_compilation = if env::var("CARGO_CFG_TARGET_POINTER_WIDTH").unwrap() == "64" {
 		let check = cc::Build::new().file("depend/check_uint128_t.c")
@@ -100,36 +299,71 @@ fn main() {
 		.debug(true)
 		.flag_if_supported("-Wno-unused-function") // some ecmult stuff is defined but not used upstream
 		.define("SECP256K1_BUILD", Some("1"))
-		// Allowed values are 2..24, there is a tradeoff between
-		// memory and cpu time (tuned for best ratio)
-		.define("ECMULT_WINDOW_SIZE", Some("8"))
-		// Allowed values are: 2, 4, and 8 (tuned for best perf)
-		.define("ECMULT_GEN_PREC_BITS", Some("4"))
-		// TODO these three should be changed to use libgmp, at least until secp PR 290 is merged
-		.define("USE_NUM_NONE", Some("1"))
-		.define("USE_FIELD_INV_BUILTIN", Some("1"))
-		.define("USE_SCALAR_INV_BUILTIN", Some("1"))
+		.define("ECMULT_WINDOW_SIZE", Some(window_size.as_str()))
+		.define("ECMULT_GEN_PREC_BITS", Some(gen_prec_bits.as_str()))
 		.define("USE_ENDOMORPHISM", Some("1"))
 		.define("ENABLE_MODULE_ECDH", Some("1"))
 		// SCHNORR support was removed in the upstream
 		// .define("ENABLE_MODULE_SCHNORR", Some("1"))
 		.define("ENABLE_MODULE_RECOVERY", Some("1"));
 
-	let target = env::var("TARGET").expect("TARGET env variable is set by cargo; qed");
+	// Precomputed tables are embedded as static data instead of being built on
+	// the heap whenever a context is created
+	let out_dir = PathBuf::from(env::var("OUT_DIR").expect("OUT_DIR env variable is set by cargo; qed"));
+	let table_dir = generate_static_tables(&out_dir, &window_size, &gen_prec_bits);
+	base_config.include(&table_dir)
+		.define("USE_ECMULT_STATIC_PRECOMPUTATION", Some("1"))
+		.define("SECP256K1_EXT_STATIC_ECMULT", Some("1"));
+
 	if target.contains("android") {
 		setup_android(&mut base_config);
 	}
 
+	let arch = env::var("CARGO_CFG_TARGET_ARCH").expect("CARGO_CFG_TARGET_ARCH env variable is set by cargo; qed");
+	CodegenConfig::from_env().apply(&mut base_config, &arch);
+
 	if let Ok(target_endian) = env::var("CARGO_CFG_TARGET_ENDIAN") {
 		if target_endian == "big" {
 			base_config.define("WORDS_BIGENDIAN", Some("1"));
 		}
 	}
 
+	// Inversion backend. The constant-time inversions (signing, key
+	// generation, ECDH, `inv_assign`) always use the builtin exponentiation
+	// ladders; with the `gmp` feature the variable-time ones (verification,
+	// recovery, affine conversions) use libgmp's extended GCD instead.
+	if env::var_os("CARGO_FEATURE_GMP").is_some() {
+		println!("cargo:rerun-if-env-changed=SECP256K1_GMP_DIR");
+		if let Some(dir) = env::var_os("SECP256K1_GMP_DIR") {
+			let dir = PathBuf::from(dir);
+			base_config.include(dir.join("include"));
+			println!("cargo:rustc-link-search=native={}", dir.join("lib").display());
+		}
+		println!("cargo:rustc-link-lib=gmp");
+		base_config.define("USE_NUM_GMP", Some("1"))
+			.define("USE_FIELD_INV_NUM", Some("1"))
+			.define("USE_SCALAR_INV_NUM", Some("1"));
+	} else {
+		base_config.define("USE_NUM_NONE", Some("1"))
+			.define("USE_FIELD_INV_BUILTIN", Some("1"))
+			.define("USE_SCALAR_INV_BUILTIN", Some("1"));
+	}
+
 	if use_64bit_compilation {
 		base_config.define("USE_FIELD_5X52", Some("1"))
 			.define("USE_SCALAR_4X64", Some("1"))
 			.define("HAVE___INT128", Some("1"));
+		// The vendored x86_64 field and scalar assembly only uses baseline
+		// x86_64 instructions, so the same binary runs on every x86_64 CPU
+		if env::var_os("CARGO_FEATURE_ASM").is_some() {
+			if arch != "x86_64" {
+				println!("cargo:warning=The asm feature has no effect on {}, using the C field implementation.", arch);
+			} else if base_config.get_compiler().is_like_msvc() {
+				println!("cargo:warning=The asm feature needs GCC-style inline assembly, using the C field implementation.");
+			} else {
+				base_config.define("USE_ASM_X86_64", Some("1"));
+			}
+		}
 	} else {
 		base_config.define("USE_FIELD_10X26", Some("1"))
 			.define("USE_SCALAR_8X32", Some("1"));
@@ -6,7 +6,1150 @@
  */
 
 #include "src/secp256k1.c"
+#include "ext_keccak.h"
+#include "contrib/lax_der_parsing.h"
 
+#ifdef SECP256K1_EXT_STATIC_ECMULT
+#include "ext_ecmult_static_context.h"
+#endif
+
+/** Largest number of items accepted by a single call to one of the batch
+ *  entry points below. Keeping it fixed lets all scratch space live on the
+ *  stack; callers split longer inputs into chunks of this size.
+ */
+#define SECP256K1_EXT_BATCH_MAX 64
+
+/** Inverts `len` nonzero scalars with a single variable-time inversion
+ *  (Montgomery's trick). Only for use on public data. `r` and `a` may not
+ *  overlap.
+ */
+static void secp256k1_ext_scalar_inverse_all_var(secp256k1_scalar *r, const secp256k1_scalar *a, size_t len) {
+    secp256k1_scalar u;
+    size_t i;
+    if (len == 0) {
+        return;
+    }
+
+    r[0] = a[0];
+    for (i = 1; i < len; i++) {
+        secp256k1_scalar_mul(&r[i], &r[i - 1], &a[i]);
+    }
+    secp256k1_scalar_inverse_var(&u, &r[len - 1]);
+    for (i = len - 1; i > 0; i--) {
+        secp256k1_scalar_mul(&r[i], &r[i - 1], &u);
+        secp256k1_scalar_mul(&u, &u, &a[i]);
+    }
+    r[0] = u;
+}
+
+/** Constant-time counterpart of secp256k1_ext_scalar_inverse_all_var, for
+ *  secret scalars. `r` and `a` may not overlap.
+ */
+static void secp256k1_ext_scalar_inverse_all(secp256k1_scalar *r, const secp256k1_scalar *a, size_t len) {
+    secp256k1_scalar u;
+    size_t i;
+    if (len == 0) {
+        return;
+    }
+
+    r[0] = a[0];
+    for (i = 1; i < len; i++) {
+        secp256k1_scalar_mul(&r[i], &r[i - 1], &a[i]);
+    }
+    secp256k1_scalar_inverse(&u, &r[len - 1]);
+    for (i = len - 1; i > 0; i--) {
+        secp256k1_scalar_mul(&r[i], &r[i - 1], &u);
+        secp256k1_scalar_mul(&u, &u, &a[i]);
+    }
+    r[0] = u;
+    secp256k1_scalar_clear(&u);
+}
+
+/** Converts `len` Jacobian points, none of them infinity, to affine
+ *  coordinates with a single constant-time field inversion (Montgomery's
+ *  trick), so it may be used on points derived from secret data. `zs` is
+ *  scratch space for `len` field elements. `r` and `a` may not overlap.
+ */
+static void secp256k1_ext_ge_set_all_gej_const(secp256k1_ge *r, const secp256k1_gej *a, secp256k1_fe *zs, size_t len) {
+    secp256k1_fe u, zi;
+    size_t i;
+    if (len == 0) {
+        return;
+    }
+
+    zs[0] = a[0].z;
+    for (i = 1; i < len; i++) {
+        secp256k1_fe_mul(&zs[i], &zs[i - 1], &a[i].z);
+    }
+    secp256k1_fe_inv(&u, &zs[len - 1]);
+    for (i = len - 1; i > 0; i--) {
+        secp256k1_fe_mul(&zi, &zs[i - 1], &u);
+        secp256k1_fe_mul(&u, &u, &a[i].z);
+        secp256k1_ge_set_gej_zinv(&r[i], &a[i], &zi);
+    }
+    secp256k1_ge_set_gej_zinv(&r[0], &a[0], &u);
+}
+
+/** Lifts the x coordinate r (plus the curve order if recid & 2) of a
+ *  recoverable signature to the point R, with the y parity given by recid.
+ */
+static int secp256k1_ext_ecdsa_sig_lift_r(secp256k1_ge *x, const secp256k1_scalar *sigr, int recid) {
+    unsigned char brx[32];
+    secp256k1_fe fx;
+    int r;
+
+    secp256k1_scalar_get_b32(brx, sigr);
+    r = secp256k1_fe_set_b32(&fx, brx);
+    (void)r;
+    VERIFY_CHECK(r); /* brx comes from a scalar, so is less than the order; certainly less than p */
+    if (recid & 2) {
+        if (secp256k1_fe_cmp_var(&fx, &secp256k1_ecdsa_const_p_minus_order) >= 0) {
+            return 0;
+        }
+        secp256k1_fe_add(&fx, &secp256k1_ecdsa_const_order_as_fe);
+    }
+    return secp256k1_ge_set_xo_var(x, &fx, recid & 1);
+}
+
+/** Same as secp256k1_ecdsa_sig_recover, except that the inverse of r is
+ *  supplied by the caller and the result is left in Jacobian coordinates so
+ *  that the affine conversion can be shared across a batch.
+ */
+static int secp256k1_ext_ecdsa_sig_recover_gej(const secp256k1_ecmult_context *ctx, secp256k1_gej *qj, const secp256k1_scalar *sigr, const secp256k1_scalar *rn, const secp256k1_scalar *sigs, const secp256k1_scalar *message, int recid) {
+    secp256k1_ge x;
+    secp256k1_gej xj;
+    secp256k1_scalar u1, u2;
+
+    if (!secp256k1_ext_ecdsa_sig_lift_r(&x, sigr, recid)) {
+        return 0;
+    }
+    secp256k1_gej_set_ge(&xj, &x);
+    secp256k1_scalar_mul(&u1, rn, message);
+    secp256k1_scalar_negate(&u1, &u1);
+    secp256k1_scalar_mul(&u2, rn, sigs);
+    secp256k1_ecmult(ctx, qj, &xj, &u2, &u1);
+    return !secp256k1_gej_is_infinity(qj);
+}
+
+/** Recovers the points for `n` (signature, message) pairs, sharing the
+ *  inversions of r and the Jacobian-to-affine conversions across the batch.
+ *  `results[i]` is set to 1 on success and to 0 if the signature was
+ *  invalid, in which case `q[i]` is the point at infinity.
+ */
+static void secp256k1_ext_ecdsa_recover_ge_batch(const secp256k1_context* ctx, secp256k1_ge *q, int *results, const secp256k1_ecdsa_recoverable_signature * const *sigs, const unsigned char * const *msg32s, size_t n) {
+    secp256k1_scalar r[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_scalar s[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_scalar rn[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_scalar m;
+    secp256k1_gej qj[SECP256K1_EXT_BATCH_MAX];
+    int recid[SECP256K1_EXT_BATCH_MAX];
+    size_t i;
+    VERIFY_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    for (i = 0; i < n; i++) {
+        secp256k1_ecdsa_recoverable_signature_load(ctx, &r[i], &s[i], &recid[i], sigs[i]);
+        VERIFY_CHECK(recid[i] >= 0 && recid[i] < 4);  /* should have been caught in parse_compact */
+        results[i] = !secp256k1_scalar_is_zero(&r[i]) && !secp256k1_scalar_is_zero(&s[i]);
+        /* Invalid entries take part in the batch inversion as one. */
+        if (!results[i]) {
+            secp256k1_scalar_set_int(&r[i], 1);
+        }
+    }
+    secp256k1_ext_scalar_inverse_all_var(rn, r, n);
+
+    for (i = 0; i < n; i++) {
+        if (results[i]) {
+            secp256k1_scalar_set_b32(&m, msg32s[i], NULL);
+            results[i] = secp256k1_ext_ecdsa_sig_recover_gej(&ctx->ecmult_ctx, &qj[i], &r[i], &rn[i], &s[i], &m, recid[i]);
+        }
+        if (!results[i]) {
+            secp256k1_gej_set_infinity(&qj[i]);
+        }
+    }
+    secp256k1_ge_set_all_gej_var(q, qj, n);
+}
+
+/** Recovers the public keys for `n` (signature, message) pairs at once.
+ *
+ *  Returns 1 if the arguments were valid; the per-item outcome is written to
+ *  `results[i]` (1 on success, 0 if the signature was invalid, in which case
+ *  `pubkeys[i]` is zeroed). The inversions of r and the Jacobian-to-affine
+ *  conversions are shared across the batch.
+ *
+ *  Args:   ctx:     pointer to a context object, initialized for verification (cannot be NULL)
+ *  Out:    pubkeys: array of `n` recovered public keys (cannot be NULL)
+ *          results: array of `n` per-item return values (cannot be NULL)
+ *  In:     sigs:    array of `n` pointers to recoverable signatures (cannot be NULL)
+ *          msg32s:  array of `n` pointers to 32-byte message hashes (cannot be NULL)
+ *          n:       number of items, at most SECP256K1_EXT_BATCH_MAX
+ */
+int secp256k1_ecdsa_recover_batch(const secp256k1_context* ctx, secp256k1_pubkey *pubkeys, int *results, const secp256k1_ecdsa_recoverable_signature * const *sigs, const unsigned char * const *msg32s, size_t n) {
+    secp256k1_ge q[SECP256K1_EXT_BATCH_MAX];
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(pubkeys != NULL);
+    ARG_CHECK(results != NULL);
+    ARG_CHECK(sigs != NULL);
+    ARG_CHECK(msg32s != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    secp256k1_ext_ecdsa_recover_ge_batch(ctx, q, results, sigs, msg32s, n);
+    for (i = 0; i < n; i++) {
+        if (results[i]) {
+            secp256k1_pubkey_save(&pubkeys[i], &q[i]);
+        } else {
+            memset(&pubkeys[i], 0, sizeof(pubkeys[i]));
+        }
+    }
+    return 1;
+}
+
+/** Writes the Ethereum address of the (non-infinity) point `q`: the last 20
+ *  bytes of the Keccak-256 hash of its 64-byte uncompressed encoding
+ *  without the 0x04 prefix.
+ */
+static void secp256k1_ext_ge_address(unsigned char *address20, secp256k1_ge *q) {
+    unsigned char buf[64];
+    unsigned char hash[32];
+
+    secp256k1_fe_normalize_var(&q->x);
+    secp256k1_fe_normalize_var(&q->y);
+    secp256k1_fe_get_b32(buf, &q->x);
+    secp256k1_fe_get_b32(buf + 32, &q->y);
+    secp256k1_ext_keccak256(hash, buf, sizeof(buf));
+    memcpy(address20, hash + 12, 20);
+}
+
+/** Recovers the Ethereum addresses of the signers of `n` (signature, message)
+ *  pairs, without materializing the public keys. Batched like
+ *  secp256k1_ecdsa_recover_batch.
+ *
+ *  Returns 1 if the arguments were valid; the per-item outcome is written to
+ *  `results[i]` (1 on success, 0 if the signature was invalid, in which case
+ *  the i-th address is zeroed).
+ *
+ *  Args:   ctx:       pointer to a context object, initialized for verification (cannot be NULL)
+ *  Out:    addresses: pointer to a 20 * n byte buffer, address i at offset 20 * i (cannot be NULL)
+ *          results:   array of `n` per-item return values (cannot be NULL)
+ *  In:     sigs:      array of `n` pointers to recoverable signatures (cannot be NULL)
+ *          msg32s:    array of `n` pointers to 32-byte message hashes (cannot be NULL)
+ *          n:         number of items, at most SECP256K1_EXT_BATCH_MAX
+ */
+int secp256k1_ext_ecdsa_recover_address_batch(const secp256k1_context* ctx, unsigned char *addresses, int *results, const secp256k1_ecdsa_recoverable_signature * const *sigs, const unsigned char * const *msg32s, size_t n) {
+    secp256k1_ge q[SECP256K1_EXT_BATCH_MAX];
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(addresses != NULL);
+    ARG_CHECK(results != NULL);
+    ARG_CHECK(sigs != NULL);
+    ARG_CHECK(msg32s != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    secp256k1_ext_ecdsa_recover_ge_batch(ctx, q, results, sigs, msg32s, n);
+    for (i = 0; i < n; i++) {
+        if (results[i]) {
+            secp256k1_ext_ge_address(addresses + 20 * i, &q[i]);
+        } else {
+            memset(addresses + 20 * i, 0, 20);
+        }
+    }
+    return 1;
+}
+
+/** Recovers the Ethereum address of the signer of `msg32`.
+ *
+ *  Returns 1 on success, 0 if the signature was invalid.
+ *  Args:   ctx:       pointer to a context object, initialized for verification (cannot be NULL)
+ *  Out:    address20: pointer to a 20-byte buffer (cannot be NULL)
+ *  In:     sig:       pointer to a recoverable signature (cannot be NULL)
+ *          msg32:     pointer to a 32-byte message hash (cannot be NULL)
+ */
+int secp256k1_ext_ecdsa_recover_address(const secp256k1_context* ctx, unsigned char *address20, const secp256k1_ecdsa_recoverable_signature *sig, const unsigned char *msg32) {
+    secp256k1_ge q;
+    secp256k1_scalar r, s;
+    secp256k1_scalar m;
+    int recid;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(address20 != NULL);
+    ARG_CHECK(sig != NULL);
+    ARG_CHECK(msg32 != NULL);
+
+    secp256k1_ecdsa_recoverable_signature_load(ctx, &r, &s, &recid, sig);
+    VERIFY_CHECK(recid >= 0 && recid < 4);  /* should have been caught in parse_compact */
+    secp256k1_scalar_set_b32(&m, msg32, NULL);
+    if (secp256k1_ecdsa_sig_recover(&ctx->ecmult_ctx, &r, &s, &q, &m, recid)) {
+        secp256k1_ext_ge_address(address20, &q);
+        return 1;
+    } else {
+        memset(address20, 0, 20);
+        return 0;
+    }
+}
+
+/** Parses a 64-byte compact r || s encoding without an intermediate
+ *  signature object. Returns 0 if r or s overflows, like
+ *  secp256k1_ecdsa_signature_parse_compact.
+ */
+static int secp256k1_ext_ecdsa_compact_load(secp256k1_scalar *r, secp256k1_scalar *s, const unsigned char *sig64) {
+    int overflow = 0;
+    int ret = 1;
+    secp256k1_scalar_set_b32(r, sig64, &overflow);
+    ret &= !overflow;
+    secp256k1_scalar_set_b32(s, sig64 + 32, &overflow);
+    ret &= !overflow;
+    return ret;
+}
+
+/** Parses a compact signature and recovers its public key in one call.
+ *
+ *  Returns 1 on success, 0 if the signature is malformed or invalid.
+ *  Args:   ctx:    pointer to a context object, initialized for verification (cannot be NULL)
+ *  Out:    pubkey: pointer to the recovered public key (cannot be NULL)
+ *  In:     sig64:  pointer to a 64-byte compact signature (cannot be NULL)
+ *          recid:  the recovery id (0, 1, 2 or 3)
+ *          msg32:  pointer to a 32-byte message hash (cannot be NULL)
+ */
+int secp256k1_ext_ecdsa_recover_compact(const secp256k1_context* ctx, secp256k1_pubkey *pubkey, const unsigned char *sig64, int recid, const unsigned char *msg32) {
+    secp256k1_ge q;
+    secp256k1_scalar r, s;
+    secp256k1_scalar m;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(pubkey != NULL);
+    ARG_CHECK(sig64 != NULL);
+    ARG_CHECK(recid >= 0 && recid <= 3);
+    ARG_CHECK(msg32 != NULL);
+
+    secp256k1_scalar_set_b32(&m, msg32, NULL);
+    if (secp256k1_ext_ecdsa_compact_load(&r, &s, sig64) &&
+        secp256k1_ecdsa_sig_recover(&ctx->ecmult_ctx, &r, &s, &q, &m, recid)) {
+        secp256k1_pubkey_save(pubkey, &q);
+        return 1;
+    } else {
+        memset(pubkey, 0, sizeof(*pubkey));
+        return 0;
+    }
+}
+
+/** Like secp256k1_ext_ecdsa_recover_compact, but outputs the Ethereum address
+ *  of the public key, as secp256k1_ext_ecdsa_recover_address.
+ */
+int secp256k1_ext_ecdsa_recover_address_compact(const secp256k1_context* ctx, unsigned char *address20, const unsigned char *sig64, int recid, const unsigned char *msg32) {
+    secp256k1_ge q;
+    secp256k1_scalar r, s;
+    secp256k1_scalar m;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(address20 != NULL);
+    ARG_CHECK(sig64 != NULL);
+    ARG_CHECK(recid >= 0 && recid <= 3);
+    ARG_CHECK(msg32 != NULL);
+
+    secp256k1_scalar_set_b32(&m, msg32, NULL);
+    if (secp256k1_ext_ecdsa_compact_load(&r, &s, sig64) &&
+        secp256k1_ecdsa_sig_recover(&ctx->ecmult_ctx, &r, &s, &q, &m, recid)) {
+        secp256k1_ext_ge_address(address20, &q);
+        return 1;
+    } else {
+        memset(address20, 0, 20);
+        return 0;
+    }
+}
+
+/** Parses a compact signature and a serialized public key and verifies the
+ *  signature in one call, with the same rules as secp256k1_ecdsa_verify
+ *  (in particular, high-S signatures are rejected).
+ *
+ *  Returns 1 if the signature is valid, 0 if it is incorrect, -1 if it is
+ *  malformed and -2 if the public key is malformed.
+ *  Args:   ctx:       pointer to a context object, initialized for verification (cannot be NULL)
+ *  In:     sig64:     pointer to a 64-byte compact signature (cannot be NULL)
+ *          msg32:     pointer to a 32-byte message hash (cannot be NULL)
+ *          input:     pointer to a serialized public key (cannot be NULL)
+ *          inputlen:  length of the public key (33 or 65)
+ */
+int secp256k1_ext_ecdsa_verify_compact(const secp256k1_context* ctx, const unsigned char *sig64, const unsigned char *msg32, const unsigned char *input, size_t inputlen) {
+    secp256k1_ge q;
+    secp256k1_scalar r, s;
+    secp256k1_scalar m;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(sig64 != NULL);
+    ARG_CHECK(msg32 != NULL);
+    ARG_CHECK(input != NULL);
+
+    if (!secp256k1_eckey_pubkey_parse(&q, input, inputlen)) {
+        return -2;
+    }
+    if (!secp256k1_ext_ecdsa_compact_load(&r, &s, sig64)) {
+        return -1;
+    }
+    secp256k1_scalar_set_b32(&m, msg32, NULL);
+    return !secp256k1_scalar_is_high(&s) &&
+           secp256k1_ecdsa_sig_verify(&ctx->ecmult_ctx, &r, &s, &q, &m);
+}
+
+/** Parses n 65-byte r || s || v signatures, where v is the recovery id
+ *  (0 to 3, without any offset such as Ethereum's 27), from a packed buffer.
+ *  The acceptance checks are evaluated for every item without branching on
+ *  the input, and a rejected item's output is zeroed by masking rather than
+ *  with a separate store.
+ *
+ *  Without `strict`, a signature is accepted like
+ *  secp256k1_ecdsa_recoverable_signature_parse_compact would: r and s must
+ *  not overflow and v must be at most 3. With `strict`, only canonical
+ *  Ethereum signatures are accepted: r and s must also be nonzero, s must
+ *  be in the lower half of the range and v must be 0 or 1.
+ *
+ *  Returns 1 when the arguments are well formed, 0 otherwise.
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    sigs:    array of n signatures (cannot be NULL); zeroed where rejected
+ *          results: array of n ints, set to 1 where the signature was accepted
+ *                   and 0 where it was rejected (cannot be NULL)
+ *  In:     input:   pointer to the packed signatures (cannot be NULL)
+ *          offsets: array of n offsets into input, each of the start of a
+ *                   65-byte signature (cannot be NULL)
+ *          n:       number of signatures, at most SECP256K1_EXT_BATCH_MAX
+ *          strict:  whether to accept only canonical Ethereum signatures
+ */
+int secp256k1_ext_ecdsa_recoverable_signature_parse_rsv_batch(const secp256k1_context* ctx, secp256k1_ecdsa_recoverable_signature *sigs, int *results, const unsigned char *input, const size_t *offsets, size_t n, int strict) {
+    size_t i, j;
+    int maxrecid;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(sigs != NULL);
+    ARG_CHECK(results != NULL);
+    ARG_CHECK(input != NULL);
+    ARG_CHECK(offsets != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    strict = !!strict;
+    maxrecid = 3 - 2 * strict;
+    for (i = 0; i < n; i++) {
+        const unsigned char *in = input + offsets[i];
+        secp256k1_scalar r, s;
+        int recid = in[64];
+        int ok = secp256k1_ext_ecdsa_compact_load(&r, &s, in);
+        unsigned char mask;
+
+        ok &= recid <= maxrecid;
+        ok &= !strict | (!secp256k1_scalar_is_zero(&r) & !secp256k1_scalar_is_zero(&s) & !secp256k1_scalar_is_high(&s));
+        secp256k1_ecdsa_recoverable_signature_save(&sigs[i], &r, &s, recid & 3);
+        mask = (unsigned char)-ok;
+        for (j = 0; j < sizeof(sigs[i].data); j++) {
+            sigs[i].data[j] &= mask;
+        }
+        results[i] = ok;
+    }
+    return 1;
+}
+
+/** Parses n DER signatures from a packed buffer, signature i spanning bytes
+ *  offsets[i] to offsets[i + 1] of input. With `lax`, signatures are parsed
+ *  with ecdsa_signature_parse_der_lax from contrib/lax_der_parsing.c
+ *  instead of secp256k1_ecdsa_signature_parse_der.
+ *
+ *  Returns 1 when the arguments are well formed, 0 otherwise.
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    sigs:    array of n signatures (cannot be NULL)
+ *          results: array of n ints, set to the result of parsing each
+ *                   signature (cannot be NULL)
+ *  In:     input:   pointer to the packed signatures (cannot be NULL)
+ *          offsets: array of n + 1 nondecreasing offsets into input (cannot be NULL)
+ *          n:       number of signatures, at most SECP256K1_EXT_BATCH_MAX
+ *          lax:     whether to accept lax DER
+ */
+int secp256k1_ext_ecdsa_signature_parse_der_batch(const secp256k1_context* ctx, secp256k1_ecdsa_signature *sigs, int *results, const unsigned char *input, const size_t *offsets, size_t n, int lax) {
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(sigs != NULL);
+    ARG_CHECK(results != NULL);
+    ARG_CHECK(input != NULL);
+    ARG_CHECK(offsets != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    if (lax) {
+        for (i = 0; i < n; i++) {
+            results[i] = ecdsa_signature_parse_der_lax(ctx, &sigs[i], input + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            results[i] = secp256k1_ecdsa_signature_parse_der(ctx, &sigs[i], input + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    }
+    return 1;
+}
+
+
+typedef struct {
+    const secp256k1_scalar *sc;
+    const secp256k1_ge *pt;
+} secp256k1_ext_ecmult_multi_data;
+
+static int secp256k1_ext_ecmult_multi_callback(secp256k1_scalar *sc, secp256k1_ge *pt, size_t idx, void *cbdata) {
+    const secp256k1_ext_ecmult_multi_data *data = (const secp256k1_ext_ecmult_multi_data *)cbdata;
+    *sc = data->sc[idx];
+    *pt = data->pt[idx];
+    return 1;
+}
+
+/** Computes `g_sc * G + sum(sc[i] * pt[i])` for `n` points with Strauss's or
+ *  Pippenger's algorithm, whichever is faster for `n`. Variable time. Returns
+ *  0 if the scratch space could not be allocated.
+ */
+static int secp256k1_ext_ecmult_multi(const secp256k1_context* ctx, secp256k1_gej *r, const secp256k1_scalar *g_sc, const secp256k1_scalar *sc, const secp256k1_ge *pt, size_t n) {
+    secp256k1_ext_ecmult_multi_data data;
+    secp256k1_scratch *scratch;
+    size_t strauss_size = secp256k1_strauss_scratch_size(n) + STRAUSS_SCRATCH_OBJECTS * ALIGNMENT;
+    size_t pippenger_size = secp256k1_pippenger_scratch_size(n, secp256k1_pippenger_bucket_window(n)) + PIPPENGER_SCRATCH_OBJECTS * ALIGNMENT;
+    int ret;
+
+    scratch = secp256k1_scratch_create(&ctx->error_callback, strauss_size > pippenger_size ? strauss_size : pippenger_size);
+    if (scratch == NULL) {
+        return 0;
+    }
+    data.sc = sc;
+    data.pt = pt;
+    ret = secp256k1_ecmult_multi_var(&ctx->error_callback, &ctx->ecmult_ctx, scratch, r, g_sc, secp256k1_ext_ecmult_multi_callback, &data, n);
+    secp256k1_scratch_destroy(&ctx->error_callback, scratch);
+    return ret;
+}
+
+/** Checks that every one of `n` recoverable signatures recovers to the given
+ *  public key, i.e. that s_i R_i = m_i G + r_i P_i where R_i is the point
+ *  encoded by r_i and the recovery id. Rather than checking each equation on
+ *  its own, the batch checks
+ *
+ *      (sum a_i m_i) G + sum (a_i r_i) P_i - sum (a_i s_i) R_i = 0
+ *
+ *  with one multi-scalar multiplication, where the weights a_i are derived
+ *  from a hash of the whole batch (a_0 = 1). A batch containing an invalid
+ *  signature passes with negligible probability.
+ *
+ *  Returns 1 if all signatures are valid, 0 otherwise.
+ *  Args:   ctx:     pointer to a context object, initialized for verification (cannot be NULL)
+ *  In:     sigs:    array of `n` pointers to recoverable signatures (cannot be NULL)
+ *          msg32s:  array of `n` pointers to 32-byte message hashes (cannot be NULL)
+ *          pubkeys: array of `n` pointers to valid public keys (cannot be NULL)
+ *          n:       number of items, at most SECP256K1_EXT_BATCH_MAX
+ */
+int secp256k1_ecdsa_verify_recoverable_batch(const secp256k1_context* ctx, const secp256k1_ecdsa_recoverable_signature * const *sigs, const unsigned char * const *msg32s, const secp256k1_pubkey * const *pubkeys, size_t n) {
+    secp256k1_scalar sc[2 * SECP256K1_EXT_BATCH_MAX];
+    secp256k1_ge pt[2 * SECP256K1_EXT_BATCH_MAX];
+    secp256k1_scalar g_sc, a, r, s, m, t;
+    secp256k1_gej result;
+    secp256k1_sha256 sha;
+    unsigned char seed[32];
+    unsigned char buf[36];
+    int recid;
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(sigs != NULL);
+    ARG_CHECK(msg32s != NULL);
+    ARG_CHECK(pubkeys != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    if (n == 0) {
+        return 1;
+    }
+
+    secp256k1_sha256_initialize(&sha);
+    for (i = 0; i < n; i++) {
+        secp256k1_sha256_write(&sha, sigs[i]->data, sizeof(sigs[i]->data));
+        secp256k1_sha256_write(&sha, msg32s[i], 32);
+        secp256k1_sha256_write(&sha, pubkeys[i]->data, sizeof(pubkeys[i]->data));
+    }
+    secp256k1_sha256_finalize(&sha, seed);
+    memcpy(buf, seed, 32);
+
+    secp256k1_scalar_set_int(&g_sc, 0);
+    for (i = 0; i < n; i++) {
+        secp256k1_ecdsa_recoverable_signature_load(ctx, &r, &s, &recid, sigs[i]);
+        if (secp256k1_scalar_is_zero(&r) || secp256k1_scalar_is_zero(&s)) {
+            return 0;
+        }
+        if (!secp256k1_pubkey_load(ctx, &pt[2 * i], pubkeys[i])) {
+            return 0;
+        }
+        if (!secp256k1_ext_ecdsa_sig_lift_r(&pt[2 * i + 1], &r, recid)) {
+            return 0;
+        }
+        secp256k1_scalar_set_b32(&m, msg32s[i], NULL);
+
+        if (i == 0) {
+            secp256k1_scalar_set_int(&a, 1);
+        } else {
+            buf[32] = (unsigned char)(i >> 24);
+            buf[33] = (unsigned char)(i >> 16);
+            buf[34] = (unsigned char)(i >> 8);
+            buf[35] = (unsigned char)i;
+            secp256k1_sha256_initialize(&sha);
+            secp256k1_sha256_write(&sha, buf, sizeof(buf));
+            secp256k1_sha256_finalize(&sha, seed);
+            secp256k1_scalar_set_b32(&a, seed, NULL);
+        }
+
+        secp256k1_scalar_mul(&t, &a, &m);
+        secp256k1_scalar_add(&g_sc, &g_sc, &t);
+        secp256k1_scalar_mul(&sc[2 * i], &a, &r);
+        secp256k1_scalar_mul(&t, &a, &s);
+        secp256k1_scalar_negate(&sc[2 * i + 1], &t);
+    }
+
+    if (!secp256k1_ext_ecmult_multi(ctx, &result, &g_sc, sc, pt, 2 * n)) {
+        return 0;
+    }
+    return secp256k1_gej_is_infinity(&result);
+}
+
+/** Computes the SHA256 hash of `len` bytes at `in` into `out32`. */
+void secp256k1_ext_sha256(unsigned char *out32, const unsigned char *in, size_t len) {
+    secp256k1_sha256 hash;
+    secp256k1_sha256_initialize(&hash);
+    secp256k1_sha256_write(&hash, in, len);
+    secp256k1_sha256_finalize(&hash, out32);
+}
+
+/** Signing state bound to one secret key. RFC6979 starts with
+ *  K = HMAC_0(V || 0x00 || key || msg) for V = 0x01...01; everything up to
+ *  the message is the same for every signature under the key, so the HMAC
+ *  state after absorbing it is kept and only resumed per message.
+ */
+typedef struct {
+    secp256k1_hmac_sha256 k0;
+    unsigned char seckey[32];
+    secp256k1_scalar sec;
+} secp256k1_ext_signing_session;
+
+/* The Rust side keeps the session in an opaque buffer of this size. */
+typedef char secp256k1_ext_signing_session_size_check[sizeof(secp256k1_ext_signing_session) <= 320 ? 1 : -1];
+
+/** Prepares a signing session for `seckey`.
+ *
+ *  Returns 1 on success, 0 if the secret key is invalid.
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    session: pointer to the session to initialize (cannot be NULL)
+ *  In:     seckey:  pointer to a 32-byte secret key (cannot be NULL)
+ */
+int secp256k1_ext_signing_session_init(const secp256k1_context* ctx, secp256k1_ext_signing_session *session, const unsigned char *seckey) {
+    static const unsigned char zero[1] = {0x00};
+    unsigned char v[32], k[32];
+    int overflow;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(session != NULL);
+    ARG_CHECK(seckey != NULL);
+
+    secp256k1_scalar_set_b32(&session->sec, seckey, &overflow);
+    if (overflow || secp256k1_scalar_is_zero(&session->sec)) {
+        memset(session, 0, sizeof(*session));
+        return 0;
+    }
+    memcpy(session->seckey, seckey, 32);
+
+    memset(v, 0x01, 32); /* RFC6979 3.2.b. */
+    memset(k, 0x00, 32); /* RFC6979 3.2.c. */
+    secp256k1_hmac_sha256_initialize(&session->k0, k, 32);
+    secp256k1_hmac_sha256_write(&session->k0, v, 32);
+    secp256k1_hmac_sha256_write(&session->k0, zero, 1);
+    secp256k1_hmac_sha256_write(&session->k0, seckey, 32);
+    return 1;
+}
+
+/** Computes the same nonce as secp256k1_nonce_function_rfc6979 for the
+ *  session's key, `msg32`, no extra data and attempt `counter`.
+ */
+static void secp256k1_ext_signing_session_nonce(const secp256k1_ext_signing_session *session, unsigned char *nonce32, const unsigned char *msg32, unsigned int counter) {
+    static const unsigned char one[1] = {0x01};
+    secp256k1_rfc6979_hmac_sha256 rng;
+    secp256k1_hmac_sha256 hmac;
+    unsigned int i;
+
+    /* RFC6979 3.2.d., resumed after V || 0x00 || key. */
+    hmac = session->k0;
+    secp256k1_hmac_sha256_write(&hmac, msg32, 32);
+    secp256k1_hmac_sha256_finalize(&hmac, rng.k);
+    memset(rng.v, 0x01, 32);
+    secp256k1_hmac_sha256_initialize(&hmac, rng.k, 32);
+    secp256k1_hmac_sha256_write(&hmac, rng.v, 32);
+    secp256k1_hmac_sha256_finalize(&hmac, rng.v);
+
+    /* RFC6979 3.2.f. */
+    secp256k1_hmac_sha256_initialize(&hmac, rng.k, 32);
+    secp256k1_hmac_sha256_write(&hmac, rng.v, 32);
+    secp256k1_hmac_sha256_write(&hmac, one, 1);
+    secp256k1_hmac_sha256_write(&hmac, session->seckey, 32);
+    secp256k1_hmac_sha256_write(&hmac, msg32, 32);
+    secp256k1_hmac_sha256_finalize(&hmac, rng.k);
+    secp256k1_hmac_sha256_initialize(&hmac, rng.k, 32);
+    secp256k1_hmac_sha256_write(&hmac, rng.v, 32);
+    secp256k1_hmac_sha256_finalize(&hmac, rng.v);
+    rng.retry = 0;
+
+    for (i = 0; i <= counter; i++) {
+        secp256k1_rfc6979_hmac_sha256_generate(&rng, nonce32, 32);
+    }
+    secp256k1_rfc6979_hmac_sha256_finalize(&rng);
+    memset(&hmac, 0, sizeof(hmac));
+}
+
+/** Signs `n` messages with the session's key into `rsigs` if it is not NULL,
+ *  and into `sigs` otherwise. Each caller below passes NULL for one of them.
+ */
+static SECP256K1_INLINE int secp256k1_ext_ecdsa_sign_batch_impl(const secp256k1_context* ctx, secp256k1_ecdsa_recoverable_signature *rsigs, secp256k1_ecdsa_signature *sigs, const secp256k1_ext_signing_session *session, const unsigned char * const *msg32s, size_t n) {
+    secp256k1_scalar k[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_scalar kinv[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_gej rj[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_ge rp[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_fe zs[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_scalar r, s, m;
+    unsigned char nonce32[32], b[32];
+    unsigned int count;
+    int overflow, recid, high;
+    int ret = 1;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        count = 0;
+        do {
+            secp256k1_ext_signing_session_nonce(session, nonce32, msg32s[i], count++);
+            secp256k1_scalar_set_b32(&k[i], nonce32, &overflow);
+        } while (overflow || secp256k1_scalar_is_zero(&k[i]));
+        secp256k1_ecmult_gen(&ctx->ecmult_gen_ctx, &rj[i], &k[i]);
+    }
+    secp256k1_ext_ge_set_all_gej_const(rp, rj, zs, n);
+    secp256k1_ext_scalar_inverse_all(kinv, k, n);
+
+    /* The rest of secp256k1_ecdsa_sig_sign. */
+    for (i = 0; i < n; i++) {
+        secp256k1_fe_normalize(&rp[i].x);
+        secp256k1_fe_normalize(&rp[i].y);
+        secp256k1_fe_get_b32(b, &rp[i].x);
+        secp256k1_scalar_set_b32(&r, b, &overflow);
+        recid = (overflow ? 2 : 0) | (secp256k1_fe_is_odd(&rp[i].y) ? 1 : 0);
+        secp256k1_scalar_set_b32(&m, msg32s[i], NULL);
+        secp256k1_scalar_mul(&s, &r, &session->sec);
+        secp256k1_scalar_add(&s, &s, &m);
+        secp256k1_scalar_mul(&s, &s, &kinv[i]);
+        if (secp256k1_scalar_is_zero(&s)) {
+            /* Negligible; the reference implementation retries with the next nonce. */
+            if (rsigs != NULL) {
+                ret &= secp256k1_ecdsa_sign_recoverable(ctx, &rsigs[i], msg32s[i], session->seckey, secp256k1_nonce_function_rfc6979, NULL);
+            } else {
+                ret &= secp256k1_ecdsa_sign(ctx, &sigs[i], msg32s[i], session->seckey, secp256k1_nonce_function_rfc6979, NULL);
+            }
+            continue;
+        }
+        high = secp256k1_scalar_is_high(&s);
+        secp256k1_scalar_cond_negate(&s, high);
+        recid ^= high;
+        if (rsigs != NULL) {
+            secp256k1_ecdsa_recoverable_signature_save(&rsigs[i], &r, &s, recid);
+        } else {
+            secp256k1_ecdsa_signature_save(&sigs[i], &r, &s);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        secp256k1_scalar_clear(&k[i]);
+        secp256k1_scalar_clear(&kinv[i]);
+        secp256k1_gej_clear(&rj[i]);
+        secp256k1_ge_clear(&rp[i]);
+    }
+    memset(zs, 0, sizeof(zs));
+    memset(nonce32, 0, sizeof(nonce32));
+    memset(b, 0, sizeof(b));
+    secp256k1_scalar_clear(&s);
+    return ret;
+}
+
+/** Signs `n` messages with the session's key. The signatures are identical
+ *  to those of secp256k1_ecdsa_sign_recoverable with the RFC6979 nonce
+ *  function, but the nonce points share one field inversion for their
+ *  affine conversion and the nonces one scalar inversion. Constant time.
+ *
+ *  Returns 1 on success.
+ *  Args:   ctx:     pointer to a context object, initialized for signing (cannot be NULL)
+ *  Out:    sigs:    array of `n` signatures (cannot be NULL)
+ *  In:     session: pointer to an initialized session (cannot be NULL)
+ *          msg32s:  array of `n` pointers to 32-byte message hashes (cannot be NULL)
+ *          n:       number of messages, at most SECP256K1_EXT_BATCH_MAX
+ */
+int secp256k1_ext_ecdsa_sign_batch(const secp256k1_context* ctx, secp256k1_ecdsa_recoverable_signature *sigs, const secp256k1_ext_signing_session *session, const unsigned char * const *msg32s, size_t n) {
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_gen_context_is_built(&ctx->ecmult_gen_ctx));
+    ARG_CHECK(sigs != NULL);
+    ARG_CHECK(session != NULL);
+    ARG_CHECK(msg32s != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+    return secp256k1_ext_ecdsa_sign_batch_impl(ctx, sigs, NULL, session, msg32s, n);
+}
+
+/** Like secp256k1_ext_ecdsa_sign_batch, but produces the signatures of
+ *  secp256k1_ecdsa_sign, without a separate conversion of each.
+ *
+ *  Returns 1 on success.
+ *  Args:   ctx:     pointer to a context object, initialized for signing (cannot be NULL)
+ *  Out:    sigs:    array of `n` signatures (cannot be NULL)
+ *  In:     session: pointer to an initialized session (cannot be NULL)
+ *          msg32s:  array of `n` pointers to 32-byte message hashes (cannot be NULL)
+ *          n:       number of messages, at most SECP256K1_EXT_BATCH_MAX
+ */
+int secp256k1_ext_ecdsa_sign_batch_standard(const secp256k1_context* ctx, secp256k1_ecdsa_signature *sigs, const secp256k1_ext_signing_session *session, const unsigned char * const *msg32s, size_t n) {
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_gen_context_is_built(&ctx->ecmult_gen_ctx));
+    ARG_CHECK(sigs != NULL);
+    ARG_CHECK(session != NULL);
+    ARG_CHECK(msg32s != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+    return secp256k1_ext_ecdsa_sign_batch_impl(ctx, NULL, sigs, session, msg32s, n);
+}
+
+/** Serializes `n` public keys into the contiguous buffer `output`, key i at
+ *  offset i * 33 (compressed) or i * 65 (uncompressed). `compressed` is a
+ *  constant in both callers below, so each gets a loop with a fixed stride
+ *  and no per-key branch on the format.
+ */
+static SECP256K1_INLINE void secp256k1_ext_pubkey_serialize_batch(const secp256k1_context* ctx, unsigned char *output, const secp256k1_pubkey *pubkeys, size_t n, int compressed) {
+    const size_t stride = compressed ? 33 : 65;
+    secp256k1_ge q;
+    size_t i, len;
+
+    for (i = 0; i < n; i++) {
+        int ret = secp256k1_pubkey_load(ctx, &q, &pubkeys[i]);
+        VERIFY_CHECK(ret);
+        (void)ret;
+        len = stride;
+        ret = secp256k1_eckey_pubkey_serialize(&q, output + i * stride, &len, compressed);
+        VERIFY_CHECK(ret && len == stride);
+        (void)ret;
+    }
+}
+
+/** Serializes `n` valid public keys in compressed form into `output`, which
+ *  must have room for 33 * n bytes. Returns 1.
+ *
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    output:  pointer to a 33 * n byte buffer (cannot be NULL if n > 0)
+ *  In:     pubkeys: array of `n` valid public keys (cannot be NULL if n > 0)
+ */
+int secp256k1_ext_pubkey_serialize_compressed_batch(const secp256k1_context* ctx, unsigned char *output, const secp256k1_pubkey *pubkeys, size_t n) {
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(n == 0 || output != NULL);
+    ARG_CHECK(n == 0 || pubkeys != NULL);
+    secp256k1_ext_pubkey_serialize_batch(ctx, output, pubkeys, n, 1);
+    return 1;
+}
+
+/** Like secp256k1_ext_pubkey_serialize_compressed_batch, but in uncompressed
+ *  form, 65 * n bytes.
+ */
+int secp256k1_ext_pubkey_serialize_uncompressed_batch(const secp256k1_context* ctx, unsigned char *output, const secp256k1_pubkey *pubkeys, size_t n) {
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(n == 0 || output != NULL);
+    ARG_CHECK(n == 0 || pubkeys != NULL);
+    secp256k1_ext_pubkey_serialize_batch(ctx, output, pubkeys, n, 0);
+    return 1;
+}
+
+/** Computes the public keys of `n` secret keys, sharing one field inversion
+ *  for the conversion of all of them to affine coordinates. Constant time
+ *  like secp256k1_ec_pubkey_create.
+ *
+ *  Returns 1 if all secret keys were valid, 0 otherwise; the public key of an
+ *  invalid secret key is zeroed.
+ *  Args:   ctx:     pointer to a context object, initialized for signing (cannot be NULL)
+ *  Out:    pubkeys: array of `n` public keys (cannot be NULL)
+ *  In:     seckeys: pointer to `n` consecutive 32-byte secret keys (cannot be NULL)
+ *          n:       number of keys, at most SECP256K1_EXT_BATCH_MAX
+ */
+int secp256k1_ext_ec_pubkey_create_batch(const secp256k1_context* ctx, secp256k1_pubkey *pubkeys, const unsigned char *seckeys, size_t n) {
+    secp256k1_gej pj[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_ge p[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_fe zs[SECP256K1_EXT_BATCH_MAX];
+    int valid[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_scalar sec;
+    int overflow;
+    int ret = 1;
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_gen_context_is_built(&ctx->ecmult_gen_ctx));
+    ARG_CHECK(pubkeys != NULL);
+    ARG_CHECK(seckeys != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    for (i = 0; i < n; i++) {
+        secp256k1_scalar_set_b32(&sec, seckeys + 32 * i, &overflow);
+        valid[i] = (!overflow) & (!secp256k1_scalar_is_zero(&sec));
+        /* Invalid keys are replaced by one, so that no point is infinity. */
+        if (!valid[i]) {
+            secp256k1_scalar_set_int(&sec, 1);
+        }
+        secp256k1_ecmult_gen(&ctx->ecmult_gen_ctx, &pj[i], &sec);
+        ret &= valid[i];
+    }
+    secp256k1_scalar_clear(&sec);
+    secp256k1_ext_ge_set_all_gej_const(p, pj, zs, n);
+
+    for (i = 0; i < n; i++) {
+        if (valid[i]) {
+            secp256k1_pubkey_save(&pubkeys[i], &p[i]);
+        } else {
+            memset(&pubkeys[i], 0, sizeof(pubkeys[i]));
+        }
+    }
+    return ret;
+}
+
+/** Writes the public keys start + step, start + 2 step, ..., start + n step
+ *  to `pubkeys`, using one group addition per key and one shared field
+ *  inversion for the affine conversions. Variable time; only for use on
+ *  public data. Stops early if the sum reaches the point at infinity.
+ *
+ *  Returns the number of keys written (0 if start or step is invalid).
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    pubkeys: array of `n` public keys (cannot be NULL)
+ *  In:     start:   pointer to the public key to start from (cannot be NULL)
+ *          step:    pointer to the public key to add at each step (cannot be NULL)
+ *          n:       number of keys, at most SECP256K1_EXT_BATCH_MAX
+ */
+int secp256k1_ext_ec_pubkey_stream(const secp256k1_context* ctx, secp256k1_pubkey *pubkeys, const secp256k1_pubkey *start, const secp256k1_pubkey *step, size_t n) {
+    secp256k1_gej pj[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_ge p[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_gej acc;
+    secp256k1_ge a, t;
+    size_t i, len;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(pubkeys != NULL);
+    ARG_CHECK(start != NULL);
+    ARG_CHECK(step != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    if (!secp256k1_pubkey_load(ctx, &a, start) || !secp256k1_pubkey_load(ctx, &t, step)) {
+        return 0;
+    }
+    secp256k1_gej_set_ge(&acc, &a);
+    for (len = 0; len < n; len++) {
+        secp256k1_gej_add_ge_var(&acc, &acc, &t, NULL);
+        if (secp256k1_gej_is_infinity(&acc)) {
+            break;
+        }
+        pj[len] = acc;
+    }
+    secp256k1_ge_set_all_gej_var(p, pj, len);
+
+    for (i = 0; i < len; i++) {
+        secp256k1_pubkey_save(&pubkeys[i], &p[i]);
+    }
+    return (int)len;
+}
+
+/** Variable-time version of secp256k1_ec_pubkey_tweak_mul, for public data
+ *  only: wNAF multiplication and a variable-time affine conversion. Does not
+ *  need a verification context.
+ *
+ *  Returns 1 on success, 0 if the tweak is out of range or zero.
+ *  Args:   ctx:    pointer to a context object (cannot be NULL)
+ *  In/Out: pubkey: pointer to a public key to multiply (cannot be NULL)
+ *  In:     tweak:  pointer to a 32-byte scalar (cannot be NULL)
+ */
+int secp256k1_ext_ec_pubkey_tweak_mul_var(const secp256k1_context* ctx, secp256k1_pubkey *pubkey, const unsigned char *tweak) {
+    secp256k1_ge p;
+    secp256k1_gej pj;
+    secp256k1_scalar factor;
+    secp256k1_scalar zero;
+    int overflow = 0;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(pubkey != NULL);
+    ARG_CHECK(tweak != NULL);
+
+    secp256k1_scalar_set_b32(&factor, tweak, &overflow);
+    if (overflow || secp256k1_scalar_is_zero(&factor) || !secp256k1_pubkey_load(ctx, &p, pubkey)) {
+        return 0;
+    }
+    /* With a zero G scalar ecmult never touches the verification tables. */
+    secp256k1_scalar_set_int(&zero, 0);
+    secp256k1_gej_set_ge(&pj, &p);
+    secp256k1_ecmult(&ctx->ecmult_ctx, &pj, &pj, &factor, &zero);
+    secp256k1_ge_set_gej_var(&p, &pj);
+    secp256k1_pubkey_save(pubkey, &p);
+    return 1;
+}
+
+/** Variable-time version of secp256k1_ec_pubkey_combine, for public data
+ *  only, taking a contiguous array of keys.
+ *
+ *  Returns 1 on success, 0 if the sum is the point at infinity (in which
+ *  case `out` is zeroed).
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    out:     pointer to the sum of the keys (cannot be NULL)
+ *  In:     pubkeys: array of `n` valid public keys (cannot be NULL)
+ *          n:       number of keys, at least 1
+ */
+int secp256k1_ext_ec_pubkey_combine_var(const secp256k1_context* ctx, secp256k1_pubkey *out, const secp256k1_pubkey *pubkeys, size_t n) {
+    secp256k1_gej qj;
+    secp256k1_ge q;
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(out != NULL);
+    memset(out, 0, sizeof(*out));
+    ARG_CHECK(n >= 1);
+    ARG_CHECK(pubkeys != NULL);
+
+    secp256k1_gej_set_infinity(&qj);
+    for (i = 0; i < n; i++) {
+        secp256k1_pubkey_load(ctx, &q, &pubkeys[i]);
+        secp256k1_gej_add_ge_var(&qj, &qj, &q, NULL);
+    }
+    if (secp256k1_gej_is_infinity(&qj)) {
+        return 0;
+    }
+    secp256k1_ge_set_gej_var(&q, &qj);
+    secp256k1_pubkey_save(out, &q);
+    return 1;
+}
+
+/** Checks public keys stored in their internal representation by some
+ *  other means than secp256k1_ec_pubkey_parse (such as a file written by the
+ *  same build). A key is valid if it is not zeroed, its coordinates are
+ *  canonical and it is on the curve. Variable time; no square roots.
+ *
+ *  Returns the index of the first invalid key, or `n` if all are valid.
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  In:     pubkeys: array of `n` public keys (cannot be NULL if n > 0)
+ */
+size_t secp256k1_ext_pubkey_find_invalid(const secp256k1_context* ctx, const secp256k1_pubkey *pubkeys, size_t n) {
+    secp256k1_pubkey canonical;
+    secp256k1_ge q;
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(n == 0 || pubkeys != NULL);
+
+    for (i = 0; i < n; i++) {
+        /* Not secp256k1_pubkey_load, whose ARG_CHECK on a zero x would call
+         * the illegal callback on untrusted input. The curve has no point
+         * with x = 0, so such keys (including the zeroed key) fail the curve
+         * check below. */
+        if (sizeof(secp256k1_ge_storage) == 64) {
+            secp256k1_ge_storage s;
+            memcpy(&s, pubkeys[i].data, sizeof(s));
+            secp256k1_ge_from_storage(&q, &s);
+        } else {
+            if (!secp256k1_fe_set_b32(&q.x, pubkeys[i].data) ||
+                !secp256k1_fe_set_b32(&q.y, pubkeys[i].data + 32)) {
+                return i;
+            }
+            q.infinity = 0;
+        }
+        if (!secp256k1_ge_is_valid_var(&q)) {
+            return i;
+        }
+        /* A coordinate encoded as a value of at least p loads as a valid
+         * point, but would compare unequal to the canonical key. */
+        secp256k1_fe_normalize_var(&q.x);
+        secp256k1_fe_normalize_var(&q.y);
+        secp256k1_pubkey_save(&canonical, &q);
+        if (memcmp(canonical.data, pubkeys[i].data, sizeof(canonical.data)) != 0) {
+            return i;
+        }
+    }
+    return n;
+}
+
+/** Same as secp256k1_ext_ec_pubkey_combine_var, for keys stored as a struct
+ *  of arrays: the 64-byte internal representation of key i is the words
+ *  limbs[0][i], ..., limbs[7][i] in that order.
+ *
+ *  Returns 1 on success, 0 if the sum is the point at infinity (in which
+ *  case `out` is zeroed).
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    out:     pointer to the sum of the keys (cannot be NULL)
+ *  In:     limbs:   array of 8 pointers to `n` words each, forming `n` valid
+ *                   public keys (cannot be NULL)
+ *          n:       number of keys, at least 1
+ */
+int secp256k1_ext_ec_pubkey_combine_soa_var(const secp256k1_context* ctx, secp256k1_pubkey *out, const uint64_t * const *limbs, size_t n) {
+    secp256k1_pubkey pubkey;
+    secp256k1_gej qj;
+    secp256k1_ge q;
+    uint64_t words[8];
+    size_t i, j;
+    VERIFY_CHECK(ctx != NULL);
+    VERIFY_CHECK(sizeof(pubkey.data) == sizeof(words));
+    ARG_CHECK(out != NULL);
+    memset(out, 0, sizeof(*out));
+    ARG_CHECK(n >= 1);
+    ARG_CHECK(limbs != NULL);
+
+    secp256k1_gej_set_infinity(&qj);
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 8; j++) {
+            words[j] = limbs[j][i];
+        }
+        memcpy(pubkey.data, words, sizeof(words));
+        secp256k1_pubkey_load(ctx, &q, &pubkey);
+        secp256k1_gej_add_ge_var(&qj, &qj, &q, NULL);
+    }
+    if (secp256k1_gej_is_infinity(&qj)) {
+        return 0;
+    }
+    secp256k1_ge_set_gej_var(&q, &qj);
+    secp256k1_pubkey_save(out, &q);
+    return 1;
+}
+
+/** Computes sum(scalars[i] * pubkeys[i]) with one multi-scalar
+ *  multiplication, staying in Jacobian coordinates until a single final
+ *  conversion. Variable time; for public data only. Does not need a
+ *  verification context.
+ *
+ *  Returns 1 on success, 0 if a scalar is out of range or zero, if the sum is
+ *  the point at infinity (`out` is zeroed in both cases) or if scratch space
+ *  could not be allocated.
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    out:     pointer to the resulting public key (cannot be NULL)
+ *  In:     pubkeys: array of `n` valid public keys (cannot be NULL)
+ *          scalars: pointer to `n` consecutive 32-byte scalars (cannot be NULL)
+ *          n:       number of terms, at least 1
+ */
+int secp256k1_ext_ec_pubkey_multi_mul_var(const secp256k1_context* ctx, secp256k1_pubkey *out, const secp256k1_pubkey *pubkeys, const unsigned char *scalars, size_t n) {
+    secp256k1_scalar *sc;
+    secp256k1_ge *pt;
+    secp256k1_scalar zero;
+    secp256k1_gej rj;
+    secp256k1_ge r;
+    int overflow;
+    int ret = 1;
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(out != NULL);
+    memset(out, 0, sizeof(*out));
+    ARG_CHECK(n >= 1);
+    ARG_CHECK(pubkeys != NULL);
+    ARG_CHECK(scalars != NULL);
+
+    sc = (secp256k1_scalar*)checked_malloc(&ctx->error_callback, n * sizeof(*sc));
+    pt = (secp256k1_ge*)checked_malloc(&ctx->error_callback, n * sizeof(*pt));
+    for (i = 0; i < n && ret; i++) {
+        secp256k1_scalar_set_b32(&sc[i], scalars + 32 * i, &overflow);
+        ret = !overflow && !secp256k1_scalar_is_zero(&sc[i]);
+        secp256k1_pubkey_load(ctx, &pt[i], &pubkeys[i]);
+    }
+    /* A zero G scalar keeps ecmult_multi away from the verification tables. */
+    secp256k1_scalar_set_int(&zero, 0);
+    if (ret) {
+        ret = secp256k1_ext_ecmult_multi(ctx, &rj, &zero, sc, pt, n) && !secp256k1_gej_is_infinity(&rj);
+    }
+    if (ret) {
+        secp256k1_ge_set_gej_var(&r, &rj);
+        secp256k1_pubkey_save(out, &r);
+    }
+    free(pt);
+    free(sc);
+    return ret;
+}
 
 static int ecdh_hash_function_raw(unsigned char *output, const unsigned char *x, const unsigned char *y, void *data) {
     (void)y;
@@ -24,6 +1167,215 @@ int secp256k1_ecdh_raw(const secp256k1_context* ctx, unsigned char *result, cons
     return secp256k1_ecdh(ctx, result, point, scalar, secp256k1_ecdh_hash_function_raw, NULL);
 }
 
+/** A table of multiples of a fixed point P for repeated constant-time
+ *  multiplication, laid out like the signing table of ecmult_gen: prec[j][i]
+ *  is (i * 16^j) P + U_j, where the offsets U_j are multiples of a point with
+ *  unknown discrete log that sum to zero. No entry is infinity, so every
+ *  window costs one constant-time lookup and one addition.
+ */
+typedef struct {
+    secp256k1_ge_storage prec[64][16];
+} secp256k1_ext_precomputed_point;
+
+/* The Rust side allocates the table as an opaque buffer of this size. */
+typedef char secp256k1_ext_precomputed_point_size_check[sizeof(secp256k1_ext_precomputed_point) == 65536 ? 1 : -1];
+
+/** Fills `table` with the multiples of `point`. Variable time; the point is
+ *  assumed to be public.
+ *
+ *  Returns 1 on success, 0 if the point is invalid.
+ *  Args:   ctx:   pointer to a context object (cannot be NULL)
+ *  Out:    table: pointer to the table to fill (cannot be NULL)
+ *  In:     point: pointer to a public key (cannot be NULL)
+ */
+int secp256k1_ext_precomputed_point_build(const secp256k1_context* ctx, secp256k1_ext_precomputed_point *table, const secp256k1_pubkey *point) {
+    static const unsigned char nums_b32[33] = "The scalar for this x is unknown";
+    secp256k1_gej *precj;
+    secp256k1_ge *prec;
+    secp256k1_ge p, nums_ge;
+    secp256k1_gej pbase, numsbase, nums_gej;
+    secp256k1_fe nums_x;
+    int i, j, r;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(table != NULL);
+    ARG_CHECK(point != NULL);
+
+    if (!secp256k1_pubkey_load(ctx, &p, point)) {
+        return 0;
+    }
+
+    /* The same nothing-up-my-sleeve point as ecmult_gen. */
+    r = secp256k1_fe_set_b32(&nums_x, nums_b32);
+    (void)r;
+    VERIFY_CHECK(r);
+    r = secp256k1_ge_set_xo_var(&nums_ge, &nums_x, 0);
+    (void)r;
+    VERIFY_CHECK(r);
+    secp256k1_gej_set_ge(&nums_gej, &nums_ge);
+    secp256k1_gej_add_ge_var(&nums_gej, &nums_gej, &secp256k1_ge_const_g, NULL);
+
+    precj = (secp256k1_gej*)checked_malloc(&ctx->error_callback, sizeof(*precj) * 64 * 16);
+    prec = (secp256k1_ge*)checked_malloc(&ctx->error_callback, sizeof(*prec) * 64 * 16);
+    secp256k1_gej_set_ge(&pbase, &p);
+    numsbase = nums_gej;
+    for (j = 0; j < 64; j++) {
+        /* precj[16j .. 16j + 15] = U_j + (0, 1, ..., 15) * 16^j P */
+        precj[j * 16] = numsbase;
+        for (i = 1; i < 16; i++) {
+            secp256k1_gej_add_var(&precj[j * 16 + i], &precj[j * 16 + i - 1], &pbase, NULL);
+        }
+        for (i = 0; i < 4; i++) {
+            secp256k1_gej_double_var(&pbase, &pbase, NULL);
+        }
+        /* U_j = 2^j U for j < 63 and U_63 = (1 - 2^63) U, so they sum to zero. */
+        secp256k1_gej_double_var(&numsbase, &numsbase, NULL);
+        if (j == 62) {
+            secp256k1_gej_neg(&numsbase, &numsbase);
+            secp256k1_gej_add_var(&numsbase, &numsbase, &nums_gej, NULL);
+        }
+    }
+    secp256k1_ge_set_all_gej_var(prec, precj, 64 * 16);
+    for (j = 0; j < 64; j++) {
+        for (i = 0; i < 16; i++) {
+            secp256k1_ge_to_storage(&table->prec[j][i], &prec[j * 16 + i]);
+        }
+    }
+    free(prec);
+    free(precj);
+    return 1;
+}
+
+/** Computes r = s P for the point P of `table`, in constant time. */
+static void secp256k1_ext_ecmult_precomputed(secp256k1_gej *r, const secp256k1_ext_precomputed_point *table, const secp256k1_scalar *s) {
+    secp256k1_ge add;
+    secp256k1_ge_storage adds;
+    int bits;
+    int i, j;
+
+    memset(&adds, 0, sizeof(adds));
+    secp256k1_gej_set_infinity(r);
+    for (j = 0; j < 64; j++) {
+        bits = secp256k1_scalar_get_bits(s, j * 4, 4);
+        for (i = 0; i < 16; i++) {
+            /* Touch every entry, so the access pattern does not depend on s. */
+            secp256k1_ge_storage_cmov(&adds, &table->prec[j][i], i == bits);
+        }
+        secp256k1_ge_from_storage(&add, &adds);
+        secp256k1_gej_add_ge(r, r, &add);
+    }
+    bits = 0;
+    secp256k1_ge_clear(&add);
+    memset(&adds, 0, sizeof(adds));
+}
+
+/** Like secp256k1_ecdh, but multiplies the point of a table built by
+ *  secp256k1_ext_precomputed_point_build, which saves the doublings and the
+ *  per-call table of secp256k1_ecmult_const.
+ *
+ *  Returns 1 on success, 0 if the scalar was invalid or hashfp failed.
+ *  Args:   ctx:    pointer to a context object (cannot be NULL)
+ *  Out:    output: pointer to the output of hashfp (cannot be NULL)
+ *  In:     table:  pointer to a precomputed point (cannot be NULL)
+ *          scalar: pointer to a 32-byte scalar (cannot be NULL)
+ *          hashfp: pointer to a hash function, NULL for the default
+ *          data:   arbitrary data passed through to hashfp
+ */
+int secp256k1_ext_ecdh_precomputed(const secp256k1_context* ctx, unsigned char *output, const secp256k1_ext_precomputed_point *table, const unsigned char *scalar, secp256k1_ecdh_hash_function hashfp, void *data) {
+    int ret = 0;
+    int overflow = 0;
+    secp256k1_gej res;
+    secp256k1_ge pt;
+    secp256k1_scalar s;
+    unsigned char x[32];
+    unsigned char y[32];
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(output != NULL);
+    ARG_CHECK(table != NULL);
+    ARG_CHECK(scalar != NULL);
+
+    if (hashfp == NULL) {
+        hashfp = secp256k1_ecdh_hash_function_default;
+    }
+
+    secp256k1_scalar_set_b32(&s, scalar, &overflow);
+    if (overflow || secp256k1_scalar_is_zero(&s)) {
+        ret = 0;
+    } else {
+        secp256k1_ext_ecmult_precomputed(&res, table, &s);
+        secp256k1_ge_set_gej(&pt, &res);
+
+        secp256k1_fe_normalize(&pt.x);
+        secp256k1_fe_normalize(&pt.y);
+        secp256k1_fe_get_b32(x, &pt.x);
+        secp256k1_fe_get_b32(y, &pt.y);
+
+        ret = hashfp(output, x, y, data);
+    }
+
+    secp256k1_scalar_clear(&s);
+    return ret;
+}
+
+/** Like secp256k1_ecdh_raw, but with a precomputed point. */
+int secp256k1_ext_ecdh_precomputed_raw(const secp256k1_context* ctx, unsigned char *result, const secp256k1_ext_precomputed_point *table, const unsigned char *scalar) {
+    return secp256k1_ext_ecdh_precomputed(ctx, result, table, scalar, secp256k1_ecdh_hash_function_raw, NULL);
+}
+
+/** Computes `n` unhashed ECDH shared secrets (the x coordinates of
+ *  scalars[i] * points[i]), sharing one constant-time field inversion for
+ *  the conversion of all products to affine coordinates.
+ *
+ *  Returns 1 if all scalars were valid, 0 otherwise; the result for an
+ *  invalid scalar is zeroed.
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  Out:    results: array of `n` 32-byte outputs (cannot be NULL)
+ *  In:     points:  array of `n` pointers to valid public keys (cannot be NULL)
+ *          scalars: array of `n` pointers to 32-byte scalars (cannot be NULL)
+ *          n:       number of items, at most SECP256K1_EXT_BATCH_MAX
+ */
+int secp256k1_ext_ecdh_raw_batch(const secp256k1_context* ctx, unsigned char *results, const secp256k1_pubkey * const *points, const unsigned char * const *scalars, size_t n) {
+    secp256k1_gej res[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_ge pt[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_fe zs[SECP256K1_EXT_BATCH_MAX];
+    int valid[SECP256K1_EXT_BATCH_MAX];
+    secp256k1_scalar s;
+    int overflow;
+    int ret = 1;
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(results != NULL);
+    ARG_CHECK(points != NULL);
+    ARG_CHECK(scalars != NULL);
+    ARG_CHECK(n <= SECP256K1_EXT_BATCH_MAX);
+
+    for (i = 0; i < n; i++) {
+        secp256k1_pubkey_load(ctx, &pt[i], points[i]);
+        secp256k1_scalar_set_b32(&s, scalars[i], &overflow);
+        valid[i] = !overflow && !secp256k1_scalar_is_zero(&s);
+        /* Invalid scalars are replaced by one, so that no product is infinity. */
+        if (!valid[i]) {
+            secp256k1_scalar_set_int(&s, 1);
+        }
+        secp256k1_ecmult_const(&res[i], &pt[i], &s, 256);
+        ret &= valid[i];
+    }
+    secp256k1_scalar_clear(&s);
+    secp256k1_ext_ge_set_all_gej_const(pt, res, zs, n);
+
+    for (i = 0; i < n; i++) {
+        if (valid[i]) {
+            secp256k1_fe_normalize(&pt[i].x);
+            secp256k1_fe_get_b32(results + 32 * i, &pt[i].x);
+        } else {
+            memset(results + 32 * i, 0, 32);
+        }
+    }
+    memset(pt, 0, sizeof(pt));
+    memset(res, 0, sizeof(res));
+    return ret;
+}
+
 /// Returns inverse (1 / n) of secret key `seckey`
 int secp256k1_ec_privkey_inverse(const secp256k1_context* ctx, unsigned char *inversed, const unsigned char* seckey) {
 	secp256k1_scalar inv;
@@ -34,8 +1386,8 @@ int secp256k1_ec_privkey_inverse(const secp256k1_context* ctx, unsigned char *in
 	ARG_CHECK(inversed != NULL);
 	ARG_CHECK(seckey != NULL);
 
-	secp256k1_scalar_set_b32(&sec, seckey, NULL);
-	ret = !overflow;
+	secp256k1_scalar_set_b32(&sec, seckey, &overflow);
+	ret = !overflow && !secp256k1_scalar_is_zero(&sec);
 	if (ret) {
 		memset(inversed, 0, 32);
 		secp256k1_scalar_inverse(&inv, &sec);
@@ -46,3 +1398,151 @@ int secp256k1_ec_privkey_inverse(const secp256k1_context* ctx, unsigned char *in
 	secp256k1_scalar_clear(&sec);
 	return ret;
 }
+
+/** Inverts `n` secret keys in place with Montgomery's trick: one
+ *  constant-time scalar inversion and 3(n - 1) multiplications in total.
+ *
+ *  Returns 1 on success, 0 if a key is out of range or zero, in which case
+ *  the keys are left unchanged.
+ *  Args:   ctx:     pointer to a context object (cannot be NULL)
+ *  In/Out: seckeys: pointer to `n` consecutive 32-byte secret keys (cannot be NULL if n > 0)
+ */
+int secp256k1_ext_ec_privkey_inverse_batch(const secp256k1_context* ctx, unsigned char *seckeys, size_t n) {
+    secp256k1_scalar *prefix;
+    secp256k1_scalar a, u, inv;
+    int overflow = 0;
+    int ret = 1;
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(n == 0 || seckeys != NULL);
+    if (n == 0) {
+        return 1;
+    }
+
+    /* prefix[i] = a_0 * ... * a_i */
+    prefix = (secp256k1_scalar*)checked_malloc(&ctx->error_callback, n * sizeof(*prefix));
+    for (i = 0; i < n; i++) {
+        secp256k1_scalar_set_b32(&a, seckeys + 32 * i, &overflow);
+        ret &= !overflow && !secp256k1_scalar_is_zero(&a);
+        if (i == 0) {
+            prefix[0] = a;
+        } else {
+            secp256k1_scalar_mul(&prefix[i], &prefix[i - 1], &a);
+        }
+    }
+
+    if (ret) {
+        /* u = (a_0 * ... * a_i)^-1, walking i down; the input keys are
+         * re-read before being overwritten, so no second array is needed. */
+        secp256k1_scalar_inverse(&u, &prefix[n - 1]);
+        for (i = n - 1; i > 0; i--) {
+            secp256k1_scalar_set_b32(&a, seckeys + 32 * i, NULL);
+            secp256k1_scalar_mul(&inv, &prefix[i - 1], &u);
+            secp256k1_scalar_mul(&u, &u, &a);
+            secp256k1_scalar_get_b32(seckeys + 32 * i, &inv);
+        }
+        secp256k1_scalar_get_b32(seckeys, &u);
+    }
+
+    for (i = 0; i < n; i++) {
+        secp256k1_scalar_clear(&prefix[i]);
+    }
+    free(prefix);
+    secp256k1_scalar_clear(&a);
+    secp256k1_scalar_clear(&u);
+    secp256k1_scalar_clear(&inv);
+    return ret;
+}
+
+/** Creates a signing and verification context on top of the read-only tables
+ *  generated by build.rs. Only the context itself is allocated; the tables are
+ *  shared by every such context in the process.
+ *
+ *  Returns NULL if the library was built without static tables. A context
+ *  returned by this function may only be freed with
+ *  secp256k1_context_destroy_shallow.
+ */
+secp256k1_context* secp256k1_context_create_static(void) {
+#if defined(SECP256K1_EXT_STATIC_ECMULT) && defined(USE_ECMULT_STATIC_PRECOMPUTATION)
+    void *prealloc = NULL;
+    secp256k1_context* ret = (secp256k1_context*)checked_malloc(&default_error_callback, sizeof(secp256k1_context));
+    ret->illegal_callback = default_illegal_callback;
+    ret->error_callback = default_error_callback;
+
+    /* The tables are never written to once built. */
+    ret->ecmult_ctx.pre_g = (secp256k1_ge_storage (*)[])(void *)secp256k1_ext_static_pre_g;
+#ifdef USE_ENDOMORPHISM
+    ret->ecmult_ctx.pre_g_128 = (secp256k1_ge_storage (*)[])(void *)secp256k1_ext_static_pre_g_128;
+#endif
+    secp256k1_ecmult_gen_context_init(&ret->ecmult_gen_ctx);
+    secp256k1_ecmult_gen_context_build(&ret->ecmult_gen_ctx, &prealloc);
+    return ret;
+#else
+    return NULL;
+#endif
+}
+
+/** Copies the context struct, including its blinding state, but not the
+ *  precomputed tables, which the copy shares with `ctx`. Works for any
+ *  context; the caller must keep the context owning the tables alive for as
+ *  long as the copy is in use. Costs one malloc of sizeof(secp256k1_context).
+ *  A context returned by this function may only be freed with
+ *  secp256k1_context_destroy_shallow.
+ */
+secp256k1_context* secp256k1_context_clone_shallow(const secp256k1_context* ctx) {
+    secp256k1_context* ret;
+    VERIFY_CHECK(ctx != NULL);
+
+    ret = (secp256k1_context*)checked_malloc(&ctx->error_callback, sizeof(secp256k1_context));
+    memcpy(ret, ctx, sizeof(secp256k1_context));
+    return ret;
+}
+
+/** Frees a context created by secp256k1_context_create_static or
+ *  secp256k1_context_clone_shallow, leaving the tables untouched.
+ */
+void secp256k1_context_destroy_shallow(secp256k1_context* ctx) {
+    if (ctx != NULL) {
+        secp256k1_ecmult_gen_context_clear(&ctx->ecmult_gen_ctx);
+        secp256k1_ecmult_context_init(&ctx->ecmult_ctx);
+        free(ctx);
+    }
+}
+
+/** Reports the memory used by a context: the size of the context struct,
+ *  which every context and clone owns, and the sizes of its signing
+ *  (ecmult_gen) and verification (ecmult) tables, 0 for a table it does not
+ *  have. A table is static if it is compiled-in read-only data rather than
+ *  allocated by secp256k1_context_create.
+ *
+ *  Args:   ctx:           pointer to a context object (cannot be NULL)
+ *  Out:    context:       size of the context struct (cannot be NULL)
+ *          gen:           size of the signing table (cannot be NULL)
+ *          ecmult:        size of the verification tables (cannot be NULL)
+ *          gen_static:    whether the signing table is static (cannot be NULL)
+ *          ecmult_static: whether the verification tables are static (cannot be NULL)
+ */
+void secp256k1_ext_context_footprint(const secp256k1_context* ctx, size_t *context, size_t *gen, size_t *ecmult, int *gen_static, int *ecmult_static) {
+    VERIFY_CHECK(ctx != NULL);
+
+    *context = sizeof(secp256k1_context);
+    *gen = 0;
+    *ecmult = 0;
+    *gen_static = 0;
+    *ecmult_static = 0;
+    if (secp256k1_ecmult_gen_context_is_built(&ctx->ecmult_gen_ctx)) {
+        *gen = sizeof(*ctx->ecmult_gen_ctx.prec);
+#ifdef USE_ECMULT_STATIC_PRECOMPUTATION
+        *gen_static = 1;
+#endif
+    }
+    if (secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx)) {
+        *ecmult = sizeof(secp256k1_ge_storage) * ECMULT_TABLE_SIZE(WINDOW_G);
+#ifdef USE_ENDOMORPHISM
+        *ecmult *= 2;
+#endif
+#if defined(SECP256K1_EXT_STATIC_ECMULT) && defined(USE_ECMULT_STATIC_PRECOMPUTATION)
+        *ecmult_static = (const void *)ctx->ecmult_ctx.pre_g == (const void *)secp256k1_ext_static_pre_g;
+#endif
+    }
+}
@@ -0,0 +1,111 @@
+/** @file ext_keccak.h
+ * Keccak-256 (the original Keccak padding used by Ethereum, not FIPS 202
+ * SHA3-256) for the address helpers in ext.c. Portable C, independent of
+ * host endianness; not constant time with respect to the input length.
+ */
+
+#ifndef SECP256K1_EXT_KECCAK_H
+#define SECP256K1_EXT_KECCAK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/** Rate of Keccak-256 in bytes: 1600 bits of state minus twice the output. */
+#define SECP256K1_EXT_KECCAK256_RATE 136
+
+static const uint64_t secp256k1_ext_keccak_rc[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL,
+    0x8000000080008000ULL, 0x000000000000808bULL, 0x0000000080000001ULL,
+    0x8000000080008081ULL, 0x8000000000008009ULL, 0x000000000000008aULL,
+    0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL,
+    0x8000000000008003ULL, 0x8000000000008002ULL, 0x8000000000000080ULL,
+    0x000000000000800aULL, 0x800000008000000aULL, 0x8000000080008081ULL,
+    0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+/* Rotation amounts and lane permutation of the combined rho and pi steps. */
+static const unsigned char secp256k1_ext_keccak_rotc[24] = {
+    1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44
+};
+static const unsigned char secp256k1_ext_keccak_piln[24] = {
+    10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1
+};
+
+#define SECP256K1_EXT_ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static void secp256k1_ext_keccakf(uint64_t *st) {
+    uint64_t bc[5], t;
+    int i, j, round;
+
+    for (round = 0; round < 24; round++) {
+        /* theta */
+        for (i = 0; i < 5; i++) {
+            bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+        }
+        for (i = 0; i < 5; i++) {
+            t = bc[(i + 4) % 5] ^ SECP256K1_EXT_ROTL64(bc[(i + 1) % 5], 1);
+            for (j = 0; j < 25; j += 5) {
+                st[j + i] ^= t;
+            }
+        }
+        /* rho and pi */
+        t = st[1];
+        for (i = 0; i < 24; i++) {
+            j = secp256k1_ext_keccak_piln[i];
+            bc[0] = st[j];
+            st[j] = SECP256K1_EXT_ROTL64(t, secp256k1_ext_keccak_rotc[i]);
+            t = bc[0];
+        }
+        /* chi */
+        for (j = 0; j < 25; j += 5) {
+            for (i = 0; i < 5; i++) {
+                bc[i] = st[j + i];
+            }
+            for (i = 0; i < 5; i++) {
+                st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+            }
+        }
+        /* iota */
+        st[0] ^= secp256k1_ext_keccak_rc[round];
+    }
+}
+
+#undef SECP256K1_EXT_ROTL64
+
+/* XORs `len` <= 136 bytes into the state, lanes in little-endian order. */
+static void secp256k1_ext_keccak_absorb(uint64_t *st, const unsigned char *in, size_t len) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+        st[i / 8] ^= (uint64_t)in[i] << (8 * (i % 8));
+    }
+}
+
+/** Computes the Keccak-256 hash of `len` bytes at `in` into `out32`. */
+static void secp256k1_ext_keccak256(unsigned char *out32, const unsigned char *in, size_t len) {
+    uint64_t st[25];
+    unsigned char last[SECP256K1_EXT_KECCAK256_RATE];
+    size_t i;
+
+    memset(st, 0, sizeof(st));
+    while (len >= SECP256K1_EXT_KECCAK256_RATE) {
+        secp256k1_ext_keccak_absorb(st, in, SECP256K1_EXT_KECCAK256_RATE);
+        secp256k1_ext_keccakf(st);
+        in += SECP256K1_EXT_KECCAK256_RATE;
+        len -= SECP256K1_EXT_KECCAK256_RATE;
+    }
+    /* Keccak pad10*1 with domain byte 0x01 (SHA3 would use 0x06). */
+    memset(last, 0, sizeof(last));
+    memcpy(last, in, len);
+    last[len] ^= 0x01;
+    last[SECP256K1_EXT_KECCAK256_RATE - 1] ^= 0x80;
+    secp256k1_ext_keccak_absorb(st, last, SECP256K1_EXT_KECCAK256_RATE);
+    secp256k1_ext_keccakf(st);
+
+    for (i = 0; i < 32; i++) {
+        out32[i] = (unsigned char)(st[i / 8] >> (8 * (i % 8)));
+    }
+}
+
+#endif /* SECP256K1_EXT_KECCAK_H */
@@ -0,0 +1,82 @@
+/** @file gen_ecmult_static.c
+ * Build-time generator for the verification (ecmult) tables of the static
+ * context in ext.c; the signing tables come from the upstream gen_context.c.
+ * Compiled for and run on the build host by build.rs, which passes the same
+ * ECMULT_WINDOW_SIZE and USE_ENDOMORPHISM settings as for the library.
+ *
+ * Usage: gen_ecmult_static <output header>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "include/secp256k1.h"
+#include "util.h"
+#include "num_impl.h"
+#include "field_impl.h"
+#include "scalar_impl.h"
+#include "group_impl.h"
+#include "scratch_impl.h"
+#include "ecmult_impl.h"
+
+static void print_table(FILE *fp, const char *name, const secp256k1_ge_storage *table, size_t len) {
+    size_t i;
+    fprintf(fp, "static const secp256k1_ge_storage %s[%lu] = {\n", name, (unsigned long)len);
+    for (i = 0; i < len; i++) {
+        fprintf(fp, "    SC(%uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu)%s\n",
+                SECP256K1_GE_STORAGE_CONST_GET(table[i]), i + 1 != len ? "," : "");
+    }
+    fprintf(fp, "};\n");
+}
+
+int main(int argc, char **argv) {
+    secp256k1_ecmult_context ctx;
+    void *prealloc, *base;
+    FILE *fp;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <output header>\n", argv[0]);
+        return 1;
+    }
+    fp = fopen(argv[1], "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open %s for writing!\n", argv[1]);
+        return 1;
+    }
+
+    base = malloc(SECP256K1_ECMULT_CONTEXT_PREALLOCATED_SIZE);
+    if (base == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    prealloc = base;
+    secp256k1_ecmult_context_init(&ctx);
+    secp256k1_ecmult_context_build(&ctx, &prealloc);
+
+    fprintf(fp, "#ifndef SECP256K1_EXT_ECMULT_STATIC_CONTEXT_H\n");
+    fprintf(fp, "#define SECP256K1_EXT_ECMULT_STATIC_CONTEXT_H\n");
+    fprintf(fp, "/* Generated by depend/gen_ecmult_static.c; do not edit. */\n");
+    fprintf(fp, "#include \"src/group.h\"\n");
+    fprintf(fp, "#define SC SECP256K1_GE_STORAGE_CONST\n");
+    fprintf(fp, "#if ECMULT_TABLE_SIZE(WINDOW_G) != %d\n", ECMULT_TABLE_SIZE(WINDOW_G));
+    fprintf(fp, "   #error configuration mismatch, invalid ECMULT_WINDOW_SIZE. Try a clean build.\n");
+    fprintf(fp, "#endif\n");
+    print_table(fp, "secp256k1_ext_static_pre_g", *ctx.pre_g, ECMULT_TABLE_SIZE(WINDOW_G));
+#ifdef USE_ENDOMORPHISM
+    fprintf(fp, "#ifndef USE_ENDOMORPHISM\n");
+    fprintf(fp, "   #error configuration mismatch, tables were generated with USE_ENDOMORPHISM.\n");
+    fprintf(fp, "#endif\n");
+    print_table(fp, "secp256k1_ext_static_pre_g_128", *ctx.pre_g_128, ECMULT_TABLE_SIZE(WINDOW_G));
+#else
+    fprintf(fp, "#ifdef USE_ENDOMORPHISM\n");
+    fprintf(fp, "   #error configuration mismatch, tables were generated without USE_ENDOMORPHISM.\n");
+    fprintf(fp, "#endif\n");
+#endif
+    fprintf(fp, "#undef SC\n");
+    fprintf(fp, "#endif\n");
+    fclose(fp);
+
+    secp256k1_ecmult_context_clear(&ctx);
+    free(base);
+    return 0;
+}
@@ -0,0 +1,335 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Public key batches
+//! Struct-of-arrays storage for large sets of public keys
+//!
+
+use std::{cmp, ptr, slice};
+
+use super::Secp256k1;
+use super::Error::{self, InvalidPublicKey};
+use key::{PublicKey, PublicKeyFormat};
+use ffi;
+
+/// Number of 64-bit words in the internal representation of a public key
+pub const LIMBS: usize = 8;
+
+/// Number of keys per aligned block of a limb array
+const BLOCK_KEYS: usize = 4;
+
+// Four consecutive keys' values of one limb; the alignment makes every limb
+// array start on a 32-byte boundary
+#[derive(Copy, Clone)]
+#[repr(C, align(32))]
+struct Block([u64; BLOCK_KEYS]);
+
+/// A set of public keys stored as a struct of arrays: the 64-byte internal
+/// representation of each key is split into `LIMBS` words, and word `j` of
+/// every key lives in the `j`th of `LIMBS` separate, 32-byte aligned arrays.
+/// Words 0 to 3 hold the x coordinate and 4 to 7 the y coordinate.
+///
+/// Scans over the keys, such as `position_x`, then run over contiguous
+/// arrays that the compiler can vectorize, and a whole batch can be saved and
+/// loaded one limb array at a time with `limb` and `from_limbs`. Like
+/// `ffi::PublicKey`, the representation depends on the build (the field
+/// implementation and the byte order), so limbs should only be exchanged
+/// between identical builds.
+#[derive(Clone)]
+pub struct PublicKeyBatch {
+    limbs: [Vec<Block>; LIMBS],
+    len: usize
+}
+
+fn to_words(pk: &PublicKey) -> [u64; LIMBS] {
+    let mut words = [0u64; LIMBS];
+    unsafe { ptr::copy_nonoverlapping(pk.as_ptr() as *const u8, words.as_mut_ptr() as *mut u8, 64); }
+    words
+}
+
+fn from_words(words: &[u64; LIMBS]) -> ffi::PublicKey {
+    let mut pk = ffi::PublicKey::new();
+    unsafe { ptr::copy_nonoverlapping(words.as_ptr() as *const u8, pk.as_mut_ptr(), 64); }
+    pk
+}
+
+impl PublicKeyBatch {
+    /// Creates an empty batch
+    pub fn new() -> PublicKeyBatch {
+        PublicKeyBatch::with_capacity(0)
+    }
+
+    /// Creates an empty batch with room for `n` keys
+    pub fn with_capacity(n: usize) -> PublicKeyBatch {
+        let blocks = (n + BLOCK_KEYS - 1) / BLOCK_KEYS;
+        PublicKeyBatch {
+            limbs: [Vec::with_capacity(blocks), Vec::with_capacity(blocks), Vec::with_capacity(blocks),
+                    Vec::with_capacity(blocks), Vec::with_capacity(blocks), Vec::with_capacity(blocks),
+                    Vec::with_capacity(blocks), Vec::with_capacity(blocks)],
+            len: 0
+        }
+    }
+
+    /// Creates a batch holding `keys`
+    pub fn from_keys(keys: &[PublicKey]) -> PublicKeyBatch {
+        let mut batch = PublicKeyBatch::with_capacity(keys.len());
+        for pk in keys {
+            batch.push(pk);
+        }
+        batch
+    }
+
+    /// Creates a batch from limb arrays as returned by `limb`, copying each
+    /// of them as a whole. Since the limbs may come from anywhere, every key
+    /// is then checked to be a valid point, failing with `InvalidPublicKey`
+    /// if any is not.
+    ///
+    /// Panics unless all limb arrays have the same length.
+    pub fn from_limbs(secp: &Secp256k1, limbs: &[&[u64]; LIMBS]) -> Result<PublicKeyBatch, Error> {
+        let len = limbs[0].len();
+        assert!(limbs.iter().all(|limb| limb.len() == len), "from_limbs: limbs differ in length");
+
+        let mut batch = PublicKeyBatch::with_capacity(len);
+        let blocks = (len + BLOCK_KEYS - 1) / BLOCK_KEYS;
+        for (dst, src) in batch.limbs.iter_mut().zip(limbs.iter()) {
+            dst.resize(blocks, Block([0; BLOCK_KEYS]));
+            unsafe { ptr::copy_nonoverlapping(src.as_ptr(), dst.as_mut_ptr() as *mut u64, len); }
+        }
+        batch.len = len;
+
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        let mut keys = [ffi::PublicKey::new(); BATCH];
+        let mut start = 0;
+        while start < len {
+            let n = cmp::min(BATCH, len - start);
+            for (i, key) in keys[..n].iter_mut().enumerate() {
+                *key = batch.raw(start + i);
+            }
+            if unsafe { ffi::secp256k1_ext_pubkey_find_invalid(secp.ctx, keys.as_ptr(), n) } != n {
+                return Err(InvalidPublicKey);
+            }
+            start += n;
+        }
+        Ok(batch)
+    }
+
+    /// The number of keys in the batch
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Whether the batch is empty
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Word `j` (`0 <= j < LIMBS`) of every key, in order
+    #[inline]
+    pub fn limb(&self, j: usize) -> &[u64] {
+        unsafe { slice::from_raw_parts(self.limbs[j].as_ptr() as *const u64, self.len) }
+    }
+
+    /// Appends `pk` to the batch
+    pub fn push(&mut self, pk: &PublicKey) {
+        let words = to_words(pk);
+        let (block, lane) = (self.len / BLOCK_KEYS, self.len % BLOCK_KEYS);
+        for (limb, &word) in self.limbs.iter_mut().zip(words.iter()) {
+            if lane == 0 {
+                limb.push(Block([0; BLOCK_KEYS]));
+            }
+            limb[block].0[lane] = word;
+        }
+        self.len += 1;
+    }
+
+    fn raw(&self, i: usize) -> ffi::PublicKey {
+        let mut words = [0u64; LIMBS];
+        for (word, limb) in words.iter_mut().zip(self.limbs.iter()) {
+            *word = limb[i / BLOCK_KEYS].0[i % BLOCK_KEYS];
+        }
+        from_words(&words)
+    }
+
+    /// The key at position `i`, if any
+    pub fn get(&self, i: usize) -> Option<PublicKey> {
+        if i >= self.len {
+            return None;
+        }
+        Some(PublicKey::from(self.raw(i)))
+    }
+
+    /// Copies the keys out into an array of `PublicKey`s
+    pub fn to_vec(&self) -> Vec<PublicKey> {
+        (0..self.len).map(|i| self.get(i).unwrap()).collect()
+    }
+
+    /// Whether every key is valid (not the zeroed key of `PublicKey::new`)
+    pub fn is_valid(&self) -> bool {
+        (0..self.len).all(|i| self.limbs.iter().any(|limb| limb[i / BLOCK_KEYS].0[i % BLOCK_KEYS] != 0))
+    }
+
+    /// The position of the first key with the same x coordinate as `pk`
+    /// (that is, `pk` or its negation), comparing four words per key with no
+    /// FFI calls
+    pub fn position_x(&self, pk: &PublicKey) -> Option<usize> {
+        let words = to_words(pk);
+        let x = &words[..4];
+        for b in 0..self.limbs[0].len() {
+            let mut found = [true; BLOCK_KEYS];
+            for (j, &word) in x.iter().enumerate() {
+                let block = &self.limbs[j][b].0;
+                for lane in 0..BLOCK_KEYS {
+                    found[lane] &= block[lane] == word;
+                }
+            }
+            // The padding after the last key is zero and never matches a
+            // valid key, but may match an invalid one
+            for lane in 0..BLOCK_KEYS {
+                if found[lane] && b * BLOCK_KEYS + lane < self.len {
+                    return Some(b * BLOCK_KEYS + lane);
+                }
+            }
+        }
+        None
+    }
+
+    /// Serializes the keys back to back into `output` in the format `F`, like
+    /// `PublicKey::serialize_batch`. Fails with `InvalidPublicKey`, writing
+    /// nothing, if any key is invalid.
+    ///
+    /// Panics unless `output.len() == self.len() * F::SIZE`.
+    pub fn serialize<F: PublicKeyFormat>(&self, secp: &Secp256k1, output: &mut [u8]) -> Result<(), Error> {
+        metrics_timer!(secp, Serialize, self.len);
+        metrics_span!("pubkey_batch_serialize", self.len);
+        assert_eq!(output.len(), self.len * F::SIZE, "serialize: output has the wrong length");
+        if !self.is_valid() {
+            return Err(InvalidPublicKey);
+        }
+
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        let mut keys = [ffi::PublicKey::new(); BATCH];
+        let mut start = 0;
+        while start < self.len {
+            let n = cmp::min(BATCH, self.len - start);
+            for (i, key) in keys[..n].iter_mut().enumerate() {
+                *key = self.raw(start + i);
+            }
+            unsafe {
+                let res = F::serialize_raw(secp.ctx, output[start * F::SIZE..].as_mut_ptr(),
+                                           keys.as_ptr(), n);
+                debug_assert_eq!(res, 1);
+            }
+            start += n;
+        }
+        Ok(())
+    }
+
+    /// Adds up the keys in variable time, for public keys only, reading them
+    /// directly from the limb arrays. Equivalent to
+    /// `PublicKey::combine_vartime` on `to_vec()`.
+    pub fn combine_vartime(&self, secp: &Secp256k1) -> Result<PublicKey, Error> {
+        metrics_timer!(secp, Combine);
+        metrics_span!("pubkey_batch_combine_vartime", self.len);
+        if self.is_empty() || !self.is_valid() {
+            return Err(InvalidPublicKey);
+        }
+        let mut limbs: [*const u64; LIMBS] = [ptr::null(); LIMBS];
+        for (ptr, limb) in limbs.iter_mut().zip(self.limbs.iter()) {
+            *ptr = limb.as_ptr() as *const u64;
+        }
+        let mut sum = ffi::PublicKey::new();
+        unsafe {
+            if ffi::secp256k1_ext_ec_pubkey_combine_soa_var(secp.ctx, &mut sum, limbs.as_ptr(), self.len) == 1 {
+                Ok(PublicKey::from(sum))
+            } else {
+                Err(InvalidPublicKey)
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use rand::thread_rng;
+
+    use super::super::Secp256k1;
+    use super::super::Error::InvalidPublicKey;
+    use key::{PublicKey, Compressed, Uncompressed};
+    use super::{PublicKeyBatch, LIMBS};
+
+    #[test]
+    fn batch_roundtrip() {
+        let s = Secp256k1::new();
+        let keys: Vec<_> = (0..37).map(|_| s.generate_keypair(&mut thread_rng()).unwrap().1).collect();
+
+        let batch = PublicKeyBatch::from_keys(&keys);
+        assert_eq!(batch.len(), keys.len());
+        assert_eq!(batch.to_vec(), keys);
+        assert_eq!(batch.get(keys.len()), None);
+        for j in 0..LIMBS {
+            assert_eq!(batch.limb(j).as_ptr() as usize % 32, 0);
+        }
+
+        let limbs = [batch.limb(0), batch.limb(1), batch.limb(2), batch.limb(3),
+                     batch.limb(4), batch.limb(5), batch.limb(6), batch.limb(7)];
+        assert_eq!(PublicKeyBatch::from_limbs(&s, &limbs).unwrap().to_vec(), keys);
+        assert!(PublicKeyBatch::from_limbs(&s, &[&[]; LIMBS]).unwrap().is_empty());
+
+        // A key off the curve is rejected
+        let mut y = batch.limb(5).to_vec();
+        y[30] ^= 1;
+        let limbs = [batch.limb(0), batch.limb(1), batch.limb(2), batch.limb(3),
+                     batch.limb(4), &y[..], batch.limb(6), batch.limb(7)];
+        assert_eq!(PublicKeyBatch::from_limbs(&s, &limbs).err(), Some(InvalidPublicKey));
+        // So is one with a zero x coordinate
+        let x = vec![0; keys.len()];
+        let limbs = [&x[..], &x[..], &x[..], &x[..],
+                     batch.limb(4), batch.limb(5), batch.limb(6), batch.limb(7)];
+        assert_eq!(PublicKeyBatch::from_limbs(&s, &limbs).err(), Some(InvalidPublicKey));
+        assert!(PublicKeyBatch::new().is_empty());
+    }
+
+    #[test]
+    fn batch_kernels() {
+        let s = Secp256k1::new();
+        let keys: Vec<_> = (0..150).map(|_| s.generate_keypair(&mut thread_rng()).unwrap().1).collect();
+        let batch = PublicKeyBatch::from_keys(&keys);
+
+        let mut expected = vec![0; keys.len() * 33];
+        PublicKey::serialize_batch::<Compressed>(&s, &keys, &mut expected).unwrap();
+        let mut output = vec![0; keys.len() * 33];
+        batch.serialize::<Compressed>(&s, &mut output).unwrap();
+        assert_eq!(output, expected);
+        let mut expected = vec![0; keys.len() * 65];
+        PublicKey::serialize_batch::<Uncompressed>(&s, &keys, &mut expected).unwrap();
+        let mut output = vec![0; keys.len() * 65];
+        batch.serialize::<Uncompressed>(&s, &mut output).unwrap();
+        assert_eq!(output, expected);
+
+        assert_eq!(batch.combine_vartime(&s), PublicKey::combine_vartime(&s, &keys));
+        assert_eq!(PublicKeyBatch::new().combine_vartime(&s), Err(InvalidPublicKey));
+
+        assert_eq!(batch.position_x(&keys[0]), Some(0));
+        assert_eq!(batch.position_x(&keys[149]), Some(149));
+        let (_, other) = s.generate_keypair(&mut thread_rng()).unwrap();
+        assert_eq!(batch.position_x(&other), None);
+
+        let mut invalid = batch.clone();
+        invalid.push(&PublicKey::new());
+        assert!(!invalid.is_valid());
+        assert_eq!(invalid.combine_vartime(&s), Err(InvalidPublicKey));
+        let mut output = vec![0; invalid.len() * 33];
+        assert_eq!(invalid.serialize::<Compressed>(&s, &mut output), Err(InvalidPublicKey));
+    }
+}
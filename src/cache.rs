@@ -0,0 +1,495 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Result caches
+//! Bounded caches of public key recoveries and of successful verifications,
+//! for signatures which are checked again and again (at gossip, at mempool
+//! admission, at block import). Attach them to a context with
+//! `Secp256k1::set_recover_cache` and `Secp256k1::set_sig_cache`.
+//!
+
+use std::collections::HashMap;
+use std::collections::hash_map::RandomState;
+use std::hash::{self, BuildHasher, Hasher};
+use std::sync::Mutex;
+use std::sync::atomic::{AtomicUsize, AtomicU64, Ordering};
+use std::{cmp, fmt, slice, usize};
+
+use rand::{RngCore, thread_rng};
+
+use super::{Error, Message, Signature, RecoverableSignature};
+use key::PublicKey;
+use constants;
+use ffi;
+
+/// Default number of shards, see `RecoverCache::with_shards`
+pub const DEFAULT_SHARDS: usize = 16;
+
+const KEY_SIZE: usize = constants::MESSAGE_SIZE + 65;
+
+// Message followed by the signature in its 65-byte internal representation
+#[derive(Copy)]
+struct Key([u8; KEY_SIZE]);
+
+impl Key {
+    fn new(msg: &Message, sig: &RecoverableSignature) -> Key {
+        let mut key = [0; KEY_SIZE];
+        key[..constants::MESSAGE_SIZE].copy_from_slice(&msg[..]);
+        key[constants::MESSAGE_SIZE..].copy_from_slice(&sig.0[..]);
+        Key(key)
+    }
+}
+
+impl Clone for Key {
+    fn clone(&self) -> Key { *self }
+}
+
+impl PartialEq for Key {
+    fn eq(&self, other: &Key) -> bool { self.0[..] == other.0[..] }
+}
+impl Eq for Key {}
+
+impl hash::Hash for Key {
+    fn hash<H: hash::Hasher>(&self, state: &mut H) {
+        state.write(&self.0)
+    }
+}
+
+const NIL: usize = usize::MAX;
+
+struct Entry {
+    key: Key,
+    value: Result<PublicKey, Error>,
+    prev: usize,
+    next: usize
+}
+
+// One LRU list: entries live in a slab, linked from the most (head) to the
+// least (tail) recently used, and are found through the map
+struct Shard {
+    map: HashMap<Key, usize, RandomState>,
+    entries: Vec<Entry>,
+    head: usize,
+    tail: usize,
+    capacity: usize
+}
+
+impl Shard {
+    fn new(capacity: usize, hasher: RandomState) -> Shard {
+        Shard {
+            map: HashMap::with_capacity_and_hasher(capacity, hasher),
+            entries: Vec::with_capacity(capacity),
+            head: NIL,
+            tail: NIL,
+            capacity: capacity
+        }
+    }
+
+    fn unlink(&mut self, idx: usize) {
+        let (prev, next) = (self.entries[idx].prev, self.entries[idx].next);
+        if prev == NIL { self.head = next; } else { self.entries[prev].next = next; }
+        if next == NIL { self.tail = prev; } else { self.entries[next].prev = prev; }
+    }
+
+    fn push_front(&mut self, idx: usize) {
+        self.entries[idx].prev = NIL;
+        self.entries[idx].next = self.head;
+        if self.head == NIL { self.tail = idx; } else { self.entries[self.head].prev = idx; }
+        self.head = idx;
+    }
+
+    fn get(&mut self, key: &Key) -> Option<Result<PublicKey, Error>> {
+        let idx = match self.map.get(key) {
+            Some(&idx) => idx,
+            None => return None
+        };
+        if self.head != idx {
+            self.unlink(idx);
+            self.push_front(idx);
+        }
+        Some(self.entries[idx].value)
+    }
+
+    fn insert(&mut self, key: Key, value: Result<PublicKey, Error>) {
+        if let Some(&idx) = self.map.get(&key) {
+            self.entries[idx].value = value;
+            self.unlink(idx);
+            self.push_front(idx);
+            return;
+        }
+
+        let idx = if self.entries.len() < self.capacity {
+            self.entries.push(Entry { key: key, value: value, prev: NIL, next: NIL });
+            self.entries.len() - 1
+        } else {
+            // Evict the least recently used entry and reuse its slot
+            let idx = self.tail;
+            self.unlink(idx);
+            self.map.remove(&self.entries[idx].key);
+            self.entries[idx].key = key;
+            self.entries[idx].value = value;
+            idx
+        };
+        self.map.insert(key, idx);
+        self.push_front(idx);
+    }
+
+    fn clear(&mut self) {
+        self.map.clear();
+        self.entries.clear();
+        self.head = NIL;
+        self.tail = NIL;
+    }
+}
+
+/// Counters of a `RecoverCache`, for sizing it
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub struct CacheStats {
+    /// Lookups answered from the cache
+    pub hits: usize,
+    /// Lookups which had to recover the key
+    pub misses: usize,
+    /// Entries currently held
+    pub len: usize,
+    /// Maximum number of entries
+    pub capacity: usize
+}
+
+/// A bounded LRU cache of `Secp256k1::recover` results, keyed by the message
+/// and the signature. Failed recoveries are cached as well. The entries are
+/// spread over independently locked shards, each its own LRU list, and no lock
+/// is held while a key is recovered, so concurrent users rarely wait on each
+/// other. A hit costs a hash of the 97-byte key and a map lookup.
+pub struct RecoverCache {
+    shards: Vec<Mutex<Shard>>,
+    hasher: RandomState,
+    hits: AtomicUsize,
+    misses: AtomicUsize
+}
+
+impl RecoverCache {
+    /// Creates a cache holding up to about `capacity` results, in
+    /// `DEFAULT_SHARDS` shards
+    pub fn new(capacity: usize) -> RecoverCache {
+        RecoverCache::with_shards(capacity, DEFAULT_SHARDS)
+    }
+
+    /// Creates a cache holding up to about `capacity` results (rounded up to a
+    /// multiple of `shards`), in `shards` shards. More shards mean less lock
+    /// contention but a less exact LRU order.
+    pub fn with_shards(capacity: usize, shards: usize) -> RecoverCache {
+        assert!(capacity > 0, "RecoverCache: capacity must be positive");
+        let shards = cmp::max(1, cmp::min(shards, capacity));
+        let per_shard = (capacity + shards - 1) / shards;
+        RecoverCache {
+            shards: (0..shards).map(|_| Mutex::new(Shard::new(per_shard, RandomState::new()))).collect(),
+            hasher: RandomState::new(),
+            hits: AtomicUsize::new(0),
+            misses: AtomicUsize::new(0)
+        }
+    }
+
+    fn shard(&self, key: &Key) -> &Mutex<Shard> {
+        let mut hasher = self.hasher.build_hasher();
+        hash::Hash::hash(key, &mut hasher);
+        &self.shards[(hasher.finish() % self.shards.len() as u64) as usize]
+    }
+
+    /// Looks up the recovery result for `msg` and `sig`, counting a hit or a
+    /// miss
+    pub fn get(&self, msg: &Message, sig: &RecoverableSignature) -> Option<Result<PublicKey, Error>> {
+        let key = Key::new(msg, sig);
+        let res = self.shard(&key).lock().unwrap().get(&key);
+        let counter = if res.is_some() { &self.hits } else { &self.misses };
+        counter.fetch_add(1, Ordering::Relaxed);
+        res
+    }
+
+    /// Stores the recovery result for `msg` and `sig`, evicting the least
+    /// recently used entry of its shard if that is full
+    pub fn insert(&self, msg: &Message, sig: &RecoverableSignature, value: Result<PublicKey, Error>) {
+        let key = Key::new(msg, sig);
+        self.shard(&key).lock().unwrap().insert(key, value);
+    }
+
+    /// Removes all entries; the counters are kept
+    pub fn clear(&self) {
+        for shard in self.shards.iter() {
+            shard.lock().unwrap().clear();
+        }
+    }
+
+    /// Returns the hit and miss counters and the occupancy
+    pub fn stats(&self) -> CacheStats {
+        let mut len = 0;
+        let mut capacity = 0;
+        for shard in self.shards.iter() {
+            let shard = shard.lock().unwrap();
+            len += shard.entries.len();
+            capacity += shard.capacity;
+        }
+        CacheStats {
+            hits: self.hits.load(Ordering::Relaxed),
+            misses: self.misses.load(Ordering::Relaxed),
+            len: len,
+            capacity: capacity
+        }
+    }
+}
+
+impl fmt::Debug for RecoverCache {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "RecoverCache({:?})", self.stats())
+    }
+}
+
+/// Number of entries per set of a `SigCache`
+pub const SIG_CACHE_WAYS: usize = 8;
+
+const SIG_ENTRY_WORDS: usize = 4;
+
+/// A fixed-size set-associative cache of (message, signature, public key)
+/// triples which have passed `Secp256k1::verify`, in the spirit of Bitcoin
+/// Core's signature cache. Each entry is the SHA256 hash of a random
+/// per-cache salt and the triple; the salt keeps others from predicting
+/// entries or sets, so they can neither forge hits nor target evictions.
+///
+/// Entries are stored as atomic words and no lock is taken, so lookups from
+/// many threads never wait. A lookup racing with an insert into the same slot
+/// may see a mix of the old and new entry, which never matches an entry that
+/// was not inserted unless 256-bit salted hashes collide.
+pub struct SigCache {
+    salt: [u8; 32],
+    words: Vec<AtomicU64>,
+    set_mask: usize
+}
+
+impl SigCache {
+    /// Creates a cache using at most `bytes` bytes of entries (32 bytes each),
+    /// rounded down to a power of two number of sets of `SIG_CACHE_WAYS`
+    /// entries, and at least one set
+    pub fn new(bytes: usize) -> SigCache {
+        let mut salt = [0; 32];
+        thread_rng().fill_bytes(&mut salt);
+
+        let wanted = cmp::max(1, bytes / (SIG_CACHE_WAYS * SIG_ENTRY_WORDS * 8));
+        let mut sets = 1;
+        while sets * 2 <= wanted {
+            sets *= 2;
+        }
+        SigCache {
+            salt: salt,
+            words: (0..sets * SIG_CACHE_WAYS * SIG_ENTRY_WORDS).map(|_| AtomicU64::new(0)).collect(),
+            set_mask: sets - 1
+        }
+    }
+
+    /// Number of entries the cache can hold
+    pub fn capacity(&self) -> usize {
+        self.words.len() / SIG_ENTRY_WORDS
+    }
+
+    fn entry(&self, msg: &Message, sig: &Signature, pk: &PublicKey) -> [u64; SIG_ENTRY_WORDS] {
+        let mut input = [0u8; 32 + constants::MESSAGE_SIZE + 64 + 64];
+        input[..32].copy_from_slice(&self.salt);
+        input[32..64].copy_from_slice(&msg[..]);
+        input[64..128].copy_from_slice(&sig.0[..]);
+        // The internal representations are canonical, so the hash does not
+        // depend on how the signature or key was encoded
+        input[128..].copy_from_slice(unsafe { slice::from_raw_parts(pk.as_ptr() as *const u8, 64) });
+
+        let mut hash = [0u8; 32];
+        unsafe { ffi::secp256k1_ext_sha256(hash.as_mut_ptr(), input.as_ptr(), input.len()); }
+        let mut entry = [0u64; SIG_ENTRY_WORDS];
+        for (i, word) in entry.iter_mut().enumerate() {
+            for &byte in hash[8 * i..8 * i + 8].iter() {
+                *word = (*word << 8) | byte as u64;
+            }
+        }
+        entry
+    }
+
+    fn set(&self, entry: &[u64; SIG_ENTRY_WORDS]) -> &[AtomicU64] {
+        let start = (entry[0] as usize & self.set_mask) * SIG_CACHE_WAYS * SIG_ENTRY_WORDS;
+        &self.words[start..start + SIG_CACHE_WAYS * SIG_ENTRY_WORDS]
+    }
+
+    fn slot_matches(slot: &[AtomicU64], entry: &[u64; SIG_ENTRY_WORDS]) -> bool {
+        slot.iter().zip(entry.iter()).all(|(word, &value)| word.load(Ordering::Relaxed) == value)
+    }
+
+    /// Whether the triple was inserted and not evicted since
+    pub fn contains(&self, msg: &Message, sig: &Signature, pk: &PublicKey) -> bool {
+        let entry = self.entry(msg, sig, pk);
+        self.set(&entry).chunks(SIG_ENTRY_WORDS).any(|slot| SigCache::slot_matches(slot, &entry))
+    }
+
+    /// Marks the triple as valid, taking a free entry of its set or else
+    /// evicting one chosen by the hash
+    pub fn insert(&self, msg: &Message, sig: &Signature, pk: &PublicKey) {
+        let entry = self.entry(msg, sig, pk);
+        let set = self.set(&entry);
+        let mut victim = (entry[1] as usize) % SIG_CACHE_WAYS;
+        for (i, slot) in set.chunks(SIG_ENTRY_WORDS).enumerate() {
+            if SigCache::slot_matches(slot, &entry) {
+                return;
+            }
+            if slot.iter().all(|word| word.load(Ordering::Relaxed) == 0) {
+                victim = i;
+                break;
+            }
+        }
+        for (word, &value) in set[victim * SIG_ENTRY_WORDS..].iter().zip(entry.iter()) {
+            word.store(value, Ordering::Relaxed);
+        }
+    }
+
+    /// Removes all entries
+    pub fn clear(&self) {
+        for word in self.words.iter() {
+            word.store(0, Ordering::Relaxed);
+        }
+    }
+}
+
+impl fmt::Debug for SigCache {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "SigCache {{ capacity: {} }}", self.capacity())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::Arc;
+    use rand::thread_rng;
+
+    use super::super::{Secp256k1, Message, RecoverableSignature, RecoveryId};
+    use super::super::Error::{InvalidSignature, IncorrectSignature};
+    use super::super::tests::random_message;
+    use super::{RecoverCache, CacheStats, SigCache, SIG_CACHE_WAYS};
+
+    fn random_input(s: &Secp256k1) -> (Message, RecoverableSignature) {
+        let msg = random_message();
+        let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+        (msg, s.sign_recoverable(&msg, &sk).unwrap())
+    }
+
+    #[test]
+    fn lru_eviction() {
+        let s = Secp256k1::new();
+        let cache = RecoverCache::with_shards(3, 1);
+        let input: Vec<_> = (0..4).map(|_| random_input(&s)).collect();
+        let pk = s.recover(&input[0].0, &input[0].1);
+
+        for &(ref msg, ref sig) in input[..3].iter() {
+            cache.insert(msg, sig, pk);
+        }
+        // Touch the oldest entry, so that the second one is evicted next
+        assert_eq!(cache.get(&input[0].0, &input[0].1), Some(pk));
+        cache.insert(&input[3].0, &input[3].1, Err(InvalidSignature));
+
+        assert_eq!(cache.get(&input[1].0, &input[1].1), None);
+        assert_eq!(cache.get(&input[0].0, &input[0].1), Some(pk));
+        assert_eq!(cache.get(&input[2].0, &input[2].1), Some(pk));
+        assert_eq!(cache.get(&input[3].0, &input[3].1), Some(Err(InvalidSignature)));
+        assert_eq!(cache.stats(), CacheStats { hits: 4, misses: 1, len: 3, capacity: 3 });
+
+        cache.clear();
+        assert_eq!(cache.get(&input[0].0, &input[0].1), None);
+        assert_eq!(cache.stats().len, 0);
+    }
+
+    #[test]
+    fn cached_recover() {
+        let mut s = Secp256k1::new();
+        let cache = Arc::new(RecoverCache::new(1000));
+        s.set_recover_cache(Some(cache.clone()));
+
+        let mut input: Vec<_> = (0..100).map(|_| random_input(&s)).collect();
+        input[7].1 = RecoverableSignature::from_compact(&s, &[0; 64], RecoveryId(0)).unwrap();
+        let expected: Vec<_> = input.iter().map(|&(ref msg, ref sig)| s.recover(msg, sig)).collect();
+        assert_eq!(cache.stats().misses, 100);
+        assert_eq!(cache.stats().len, 100);
+        assert_eq!(expected[7], Err(InvalidSignature));
+
+        // Half of the batch is cached
+        let more: Vec<_> = (0..100).map(|_| random_input(&s)).collect();
+        let batch: Vec<_> = input.iter().cloned().zip(more.iter().cloned())
+            .flat_map(|(a, b)| vec![a, b]).collect();
+        let mut output = vec![Err(InvalidSignature); batch.len()];
+        assert!(s.recover_batch(&batch, &mut output).is_ok());
+        for (i, out) in output.iter().enumerate() {
+            if i % 2 == 0 {
+                assert_eq!(*out, expected[i / 2]);
+            } else {
+                assert_eq!(*out, Secp256k1::new().recover(&batch[i].0, &batch[i].1));
+            }
+        }
+        assert_eq!(cache.stats().hits, 100);
+        assert_eq!(cache.stats().misses, 200);
+
+        // Clones share the cache
+        let clone = s.clone();
+        assert_eq!(clone.recover(&more[0].0, &more[0].1), output[1]);
+        assert_eq!(cache.stats().hits, 101);
+    }
+
+    #[test]
+    fn sig_cache() {
+        let s = Secp256k1::new();
+        let cache = SigCache::new(1 << 16);
+        assert_eq!(cache.capacity(), (1 << 16) / 32);
+        assert_eq!(SigCache::new(0).capacity(), SIG_CACHE_WAYS);
+
+        let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let msg = random_message();
+        let sig = s.sign(&msg, &sk).unwrap();
+        assert!(!cache.contains(&msg, &sig, &pk));
+        cache.insert(&msg, &sig, &pk);
+        assert!(cache.contains(&msg, &sig, &pk));
+        assert!(!cache.contains(&random_message(), &sig, &pk));
+        cache.clear();
+        assert!(!cache.contains(&msg, &sig, &pk));
+
+        // A single set keeps the most recent entries
+        let small = SigCache::new(0);
+        let triples: Vec<_> = (0..3 * SIG_CACHE_WAYS).map(|_| {
+            let msg = random_message();
+            (msg, s.sign(&msg, &sk).unwrap())
+        }).collect();
+        for &(ref msg, ref sig) in triples.iter() {
+            small.insert(msg, sig, &pk);
+            assert!(small.contains(msg, sig, &pk));
+        }
+        let hits = triples.iter().filter(|&&(ref msg, ref sig)| small.contains(msg, sig, &pk)).count();
+        assert!(hits <= SIG_CACHE_WAYS);
+    }
+
+    #[test]
+    fn cached_verify() {
+        let mut s = Secp256k1::new();
+        let cache = Arc::new(SigCache::new(1 << 16));
+        s.set_sig_cache(Some(cache.clone()));
+
+        let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let msg = random_message();
+        let sig = s.sign(&msg, &sk).unwrap();
+        assert_eq!(s.verify(&msg, &sig, &pk), Ok(()));
+        assert!(cache.contains(&msg, &sig, &pk));
+        assert_eq!(s.clone().verify(&msg, &sig, &pk), Ok(()));
+
+        // Failures are not cached
+        let other = random_message();
+        assert_eq!(s.verify(&other, &sig, &pk), Err(IncorrectSignature));
+        assert!(!cache.contains(&other, &sig, &pk));
+    }
+}
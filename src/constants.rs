@@ -32,6 +32,9 @@ pub const UNCOMPRESSED_PUBLIC_KEY_SIZE: usize = 65;
 /// The size (in bytes) of a compressed public key
 pub const COMPRESSED_PUBLIC_KEY_SIZE: usize = 33;
 
+/// The size (in bytes) of an Ethereum address
+pub const ADDRESS_SIZE: usize = 20;
+
 /// The maximum size of a signature
 pub const MAX_SIGNATURE_SIZE: usize = 72;
 
@@ -16,9 +16,10 @@
 //! Support for shared secret computations
 //!
 
-use std::ops;
+use std::{fmt, ops, ptr};
 
 use super::Secp256k1;
+use super::Error::{self, InvalidPublicKey};
 use key::{SecretKey, PublicKey};
 use ffi;
 
@@ -31,6 +32,7 @@ impl SharedSecret {
     /// Creates a new shared secret from a pubkey and secret key
     #[inline]
     pub fn new(secp: &Secp256k1, point: &PublicKey, scalar: &SecretKey) -> SharedSecret {
+        metrics_timer!(secp, Ecdh);
         unsafe {
             let mut ss = ffi::SharedSecret::blank();
             let res = ffi::secp256k1_ecdh(secp.ctx,
@@ -47,6 +49,7 @@ impl SharedSecret {
     /// Creates a new unhashed shared secret from a pubkey and secret key
     #[inline]
     pub fn new_raw(secp: &Secp256k1, point: &PublicKey, scalar: &SecretKey) -> SharedSecret {
+        metrics_timer!(secp, Ecdh);
         unsafe {
             let mut ss = ffi::SharedSecret::blank();
             let res = ffi::secp256k1_ecdh_raw(secp.ctx, &mut ss, point.as_ptr(), scalar.as_ptr());
@@ -55,6 +58,75 @@ impl SharedSecret {
         }
     }
 
+    /// Creates the unhashed shared secrets of a batch of (public key, secret
+    /// key) pairs, writing the secret for `input[i]` to `output[i]`. Equivalent
+    /// to calling `new_raw` on every pair, but crosses the FFI boundary once
+    /// per `ffi::SECP256K1_EXT_BATCH_MAX` pairs and shares one constant-time
+    /// field inversion across them. Fails with `InvalidPublicKey` if any public
+    /// key is invalid, in which case `output` is left unspecified.
+    ///
+    /// Panics if `input` and `output` differ in length.
+    pub fn new_raw_batch(secp: &Secp256k1, input: &[(PublicKey, SecretKey)], output: &mut [SharedSecret])
+                         -> Result<(), Error> {
+        metrics_timer!(secp, Ecdh, input.len());
+        metrics_span!("ecdh_raw_batch", input.len());
+        assert_eq!(input.len(), output.len(), "new_raw_batch: input and output lengths differ");
+        if input.iter().any(|&(ref pk, _)| !pk.is_valid()) {
+            return Err(InvalidPublicKey);
+        }
+
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        let mut points: [*const ffi::PublicKey; BATCH] = [ptr::null(); BATCH];
+        let mut scalars: [*const u8; BATCH] = [ptr::null(); BATCH];
+
+        for (input, output) in input.chunks(BATCH).zip(output.chunks_mut(BATCH)) {
+            for (i, &(ref pk, ref sk)) in input.iter().enumerate() {
+                points[i] = pk.as_ptr();
+                scalars[i] = sk.as_ptr();
+            }
+            unsafe {
+                // `SharedSecret` is a `repr(C)` wrapper around the FFI type
+                let res = ffi::secp256k1_ext_ecdh_raw_batch(secp.ctx, output.as_mut_ptr() as *mut ffi::SharedSecret,
+                                                            points.as_ptr(), scalars.as_ptr(), input.len());
+                // A `SecretKey` is always a valid scalar
+                debug_assert_eq!(res, 1);
+            }
+        }
+        Ok(())
+    }
+
+    /// Creates a new shared secret like `new`, from a precomputed point. The
+    /// multiplication is constant time like that of `new`, but skips the
+    /// per-call table and most of the doublings.
+    #[inline]
+    pub fn with_precomputed(secp: &Secp256k1, point: &PrecomputedPoint, scalar: &SecretKey) -> SharedSecret {
+        metrics_timer!(secp, Ecdh);
+        unsafe {
+            let mut ss = ffi::SharedSecret::blank();
+            let res = ffi::secp256k1_ext_ecdh_precomputed(secp.ctx,
+                                                          &mut ss,
+                                                          point.as_ptr(),
+                                                          scalar.as_ptr(),
+                                                          ffi::secp256k1_ecdh_hash_function_default,
+                                                          ptr::null_mut());
+            debug_assert_eq!(res, 1);
+            SharedSecret(ss)
+        }
+    }
+
+    /// Creates a new unhashed shared secret like `new_raw`, from a
+    /// precomputed point
+    #[inline]
+    pub fn with_precomputed_raw(secp: &Secp256k1, point: &PrecomputedPoint, scalar: &SecretKey) -> SharedSecret {
+        metrics_timer!(secp, Ecdh);
+        unsafe {
+            let mut ss = ffi::SharedSecret::blank();
+            let res = ffi::secp256k1_ext_ecdh_precomputed_raw(secp.ctx, &mut ss, point.as_ptr(), scalar.as_ptr());
+            debug_assert_eq!(res, 1);
+            SharedSecret(ss)
+        }
+    }
+
     /// Obtains a raw pointer suitable for use with FFI functions
     #[inline]
     pub fn as_ptr(&self) -> *const ffi::SharedSecret {
@@ -62,6 +134,51 @@ impl SharedSecret {
     }
 }
 
+/// A public key together with a table of its multiples, for repeated ECDH
+/// against the same key with `SharedSecret::with_precomputed`. The table takes
+/// 64 KiB and costs several ECDH operations to build, so it pays off only for
+/// keys used many times.
+#[derive(Clone)]
+pub struct PrecomputedPoint {
+    point: PublicKey,
+    table: Box<[u64]>
+}
+
+impl PrecomputedPoint {
+    /// Builds the table for `point`
+    pub fn new(secp: &Secp256k1, point: &PublicKey) -> Result<PrecomputedPoint, Error> {
+        if !point.is_valid() {
+            return Err(InvalidPublicKey);
+        }
+        let mut table = vec![0u64; ffi::SECP256K1_EXT_PRECOMPUTED_POINT_SIZE / 8].into_boxed_slice();
+        unsafe {
+            let res = ffi::secp256k1_ext_precomputed_point_build(secp.ctx,
+                                                                 table.as_mut_ptr() as *mut ffi::PrecomputedPoint,
+                                                                 point.as_ptr());
+            debug_assert_eq!(res, 1);
+        }
+        Ok(PrecomputedPoint { point: *point, table: table })
+    }
+
+    /// The public key the table was built for
+    #[inline]
+    pub fn public_key(&self) -> &PublicKey {
+        &self.point
+    }
+
+    /// Obtains a raw pointer suitable for use with FFI functions
+    #[inline]
+    pub fn as_ptr(&self) -> *const ffi::PrecomputedPoint {
+        self.table.as_ptr() as *const _
+    }
+}
+
+impl fmt::Debug for PrecomputedPoint {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "PrecomputedPoint({:?})", self.point)
+    }
+}
+
 /// Creates a new shared secret from a FFI shared secret
 impl From<ffi::SharedSecret> for SharedSecret {
     #[inline]
@@ -110,8 +227,9 @@ impl ops::Index<ops::RangeFull> for SharedSecret {
 #[cfg(test)]
 mod tests {
     use rand::thread_rng;
-    use super::SharedSecret;
+    use super::{SharedSecret, PrecomputedPoint};
     use super::super::Secp256k1;
+    use key::PublicKey;
 
     #[test]
     fn ecdh() {
@@ -138,6 +256,47 @@ mod tests {
         assert_eq!(sec1, sec2);
         assert!(sec_odd != sec2);
     }
+
+    #[test]
+    fn ecdh_raw_batch() {
+        let s = Secp256k1::with_caps(::ContextFlag::SignOnly);
+        let mut input = Vec::new();
+        for _ in 0..100 {
+            let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+            let (_, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+            input.push((pk, sk));
+        }
+
+        let mut output = vec![SharedSecret::from(::ffi::SharedSecret::new()); input.len()];
+        assert!(SharedSecret::new_raw_batch(&s, &input, &mut output).is_ok());
+        for (&(ref pk, ref sk), out) in input.iter().zip(output.iter()) {
+            assert_eq!(*out, SharedSecret::new_raw(&s, pk, sk));
+        }
+
+        input[70].0 = PublicKey::new();
+        assert!(SharedSecret::new_raw_batch(&s, &input, &mut output).is_err());
+        assert!(SharedSecret::new_raw_batch(&s, &[], &mut []).is_ok());
+    }
+
+    #[test]
+    fn ecdh_precomputed() {
+        let s = Secp256k1::with_caps(::ContextFlag::SignOnly);
+        let (_, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let point = PrecomputedPoint::new(&s, &pk).unwrap();
+        assert_eq!(point.public_key(), &pk);
+
+        for _ in 0..20 {
+            let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+            assert_eq!(SharedSecret::with_precomputed(&s, &point, &sk), SharedSecret::new(&s, &pk, &sk));
+            assert_eq!(SharedSecret::with_precomputed_raw(&s, &point, &sk), SharedSecret::new_raw(&s, &pk, &sk));
+        }
+        assert_eq!(SharedSecret::with_precomputed_raw(&s, &point, &::key::ONE_KEY)[..],
+                   pk.serialize_vec(&s, true)[1..]);
+        let minus_one = SharedSecret::with_precomputed_raw(&s, &point.clone(), &::key::MINUS_ONE_KEY);
+        assert_eq!(minus_one[..], pk.serialize_vec(&s, true)[1..]);
+
+        assert!(PrecomputedPoint::new(&s, &PublicKey::new()).is_err());
+    }
 }
 
 #[cfg(all(test, feature = "unstable"))]
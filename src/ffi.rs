@@ -31,6 +31,11 @@ pub const SECP256K1_SER_UNCOMPRESSED: c_uint = (1 << 1) | 0;
 /// Flag for keys to indicate compressed serialization format
 pub const SECP256K1_SER_COMPRESSED: c_uint = (1 << 1) | (1 << 8);
 
+/// Largest number of items accepted by one call to a batch function
+/// (`SECP256K1_EXT_BATCH_MAX` in depend/ext.c); longer inputs must be
+/// split into chunks of at most this size
+pub const SECP256K1_EXT_BATCH_MAX: usize = 64;
+
 /// A nonce generation function. Ordinary users of the library
 /// never need to see this type; only if you need to control
 /// nonce generation do you need to use it. I have deliberately
@@ -69,6 +74,22 @@ pub type EcdhHashFn = unsafe extern "C" fn(output: *mut c_uchar,
 #[derive(Clone, Debug)]
 #[repr(C)] pub struct Context(c_int);
 
+/// A table of multiples of a public key for repeated ECDH, see
+/// `secp256k1_ext_precomputed_point_build`. Opaque; allocate
+/// `SECP256K1_EXT_PRECOMPUTED_POINT_SIZE` bytes, 8-byte aligned, for one.
+#[repr(C)] pub struct PrecomputedPoint(c_int);
+
+/// The size (in bytes) of a `PrecomputedPoint` table
+pub const SECP256K1_EXT_PRECOMPUTED_POINT_SIZE: usize = 64 * 16 * 64;
+
+/// Signing state bound to one secret key, see
+/// `secp256k1_ext_signing_session_init`. Opaque; allocate
+/// `SECP256K1_EXT_SIGNING_SESSION_SIZE` bytes, 8-byte aligned, for one.
+#[repr(C)] pub struct SigningSession(c_int);
+
+/// An upper bound on the size (in bytes) of a `SigningSession`
+pub const SECP256K1_EXT_SIGNING_SESSION_SIZE: usize = 320;
+
 /// Library-internal representation of a Secp256k1 public key
 #[repr(C)]
 pub struct PublicKey([c_uchar; 64]);
@@ -143,6 +164,19 @@ extern "C" {
 
     pub fn secp256k1_context_destroy(cx: *mut Context);
 
+    pub fn secp256k1_context_create_static() -> *mut Context;
+
+    pub fn secp256k1_context_clone_shallow(cx: *const Context) -> *mut Context;
+
+    pub fn secp256k1_context_destroy_shallow(cx: *mut Context);
+
+    pub fn secp256k1_ext_context_footprint(cx: *const Context,
+                                           context: *mut usize,
+                                           gen: *mut usize,
+                                           ecmult: *mut usize,
+                                           gen_static: *mut c_int,
+                                           ecmult_static: *mut c_int);
+
     pub fn secp256k1_context_randomize(cx: *mut Context,
                                        seed32: *const c_uchar)
                                        -> c_int;
@@ -216,12 +250,113 @@ extern "C" {
                                             noncedata: *const c_void)
                                             -> c_int;
 
+    pub fn secp256k1_ext_sha256(out32: *mut c_uchar, input: *const c_uchar, len: usize);
+
+    pub fn secp256k1_ext_signing_session_init(cx: *const Context,
+                                              session: *mut SigningSession,
+                                              sk: *const c_uchar)
+                                              -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_sign_batch(cx: *const Context,
+                                          sigs: *mut RecoverableSignature,
+                                          session: *const SigningSession,
+                                          msg32s: *const *const c_uchar,
+                                          n: usize)
+                                          -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_sign_batch_standard(cx: *const Context,
+                                                   sigs: *mut Signature,
+                                                   session: *const SigningSession,
+                                                   msg32s: *const *const c_uchar,
+                                                   n: usize)
+                                                   -> c_int;
+
     pub fn secp256k1_ecdsa_recover(cx: *const Context,
                                    pk: *mut PublicKey,
                                    sig: *const RecoverableSignature,
                                    msg32: *const c_uchar)
                                    -> c_int;
 
+    pub fn secp256k1_ecdsa_recover_batch(cx: *const Context,
+                                         pks: *mut PublicKey,
+                                         results: *mut c_int,
+                                         sigs: *const *const RecoverableSignature,
+                                         msg32s: *const *const c_uchar,
+                                         n: usize)
+                                         -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_recover_compact(cx: *const Context,
+                                               pk: *mut PublicKey,
+                                               sig64: *const c_uchar,
+                                               recid: c_int,
+                                               msg32: *const c_uchar)
+                                               -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_recover_address_compact(cx: *const Context,
+                                                       address20: *mut c_uchar,
+                                                       sig64: *const c_uchar,
+                                                       recid: c_int,
+                                                       msg32: *const c_uchar)
+                                                       -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_verify_compact(cx: *const Context,
+                                              sig64: *const c_uchar,
+                                              msg32: *const c_uchar,
+                                              input: *const c_uchar,
+                                              in_len: usize)
+                                              -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_recoverable_signature_parse_rsv_batch(cx: *const Context,
+                                                                     sigs: *mut RecoverableSignature,
+                                                                     results: *mut c_int,
+                                                                     input: *const c_uchar,
+                                                                     offsets: *const usize,
+                                                                     n: usize,
+                                                                     strict: c_int)
+                                                                     -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_signature_parse_der_batch(cx: *const Context,
+                                                         sigs: *mut Signature,
+                                                         results: *mut c_int,
+                                                         input: *const c_uchar,
+                                                         offsets: *const usize,
+                                                         n: usize,
+                                                         lax: c_int)
+                                                         -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_recover_address(cx: *const Context,
+                                               address20: *mut c_uchar,
+                                               sig: *const RecoverableSignature,
+                                               msg32: *const c_uchar)
+                                               -> c_int;
+
+    pub fn secp256k1_ext_ecdsa_recover_address_batch(cx: *const Context,
+                                                     addresses: *mut c_uchar,
+                                                     results: *mut c_int,
+                                                     sigs: *const *const RecoverableSignature,
+                                                     msg32s: *const *const c_uchar,
+                                                     n: usize)
+                                                     -> c_int;
+
+    pub fn secp256k1_ecdsa_verify_recoverable_batch(cx: *const Context,
+                                                    sigs: *const *const RecoverableSignature,
+                                                    msg32s: *const *const c_uchar,
+                                                    pks: *const *const PublicKey,
+                                                    n: usize)
+                                                    -> c_int;
+
+    pub fn secp256k1_ext_pubkey_serialize_compressed_batch(cx: *const Context,
+                                                           output: *mut c_uchar,
+                                                           pks: *const PublicKey,
+                                                           n: usize)
+                                                           -> c_int;
+
+    pub fn secp256k1_ext_pubkey_serialize_uncompressed_batch(cx: *const Context,
+                                                             output: *mut c_uchar,
+                                                             pks: *const PublicKey,
+                                                             n: usize)
+                                                             -> c_int;
+
     // EC
     pub fn secp256k1_ec_seckey_verify(cx: *const Context,
                                       sk: *const c_uchar) -> c_int;
@@ -229,6 +364,29 @@ extern "C" {
     pub fn secp256k1_ec_pubkey_create(cx: *const Context, pk: *mut PublicKey,
                                       sk: *const c_uchar) -> c_int;
 
+    pub fn secp256k1_ext_ec_pubkey_create_batch(cx: *const Context, pks: *mut PublicKey,
+                                                sks: *const c_uchar, n: usize) -> c_int;
+
+    pub fn secp256k1_ext_ec_pubkey_stream(cx: *const Context, pks: *mut PublicKey,
+                                          start: *const PublicKey, step: *const PublicKey,
+                                          n: usize) -> c_int;
+
+    pub fn secp256k1_ext_ec_pubkey_tweak_mul_var(cx: *const Context, pk: *mut PublicKey,
+                                                 tweak: *const c_uchar) -> c_int;
+
+    pub fn secp256k1_ext_ec_pubkey_combine_var(cx: *const Context, out: *mut PublicKey,
+                                               ins: *const PublicKey, n: usize) -> c_int;
+
+    pub fn secp256k1_ext_pubkey_find_invalid(cx: *const Context, pks: *const PublicKey,
+                                             n: usize) -> usize;
+
+    pub fn secp256k1_ext_ec_pubkey_combine_soa_var(cx: *const Context, out: *mut PublicKey,
+                                                   limbs: *const *const u64, n: usize) -> c_int;
+
+    pub fn secp256k1_ext_ec_pubkey_multi_mul_var(cx: *const Context, out: *mut PublicKey,
+                                                 pks: *const PublicKey, scalars: *const c_uchar,
+                                                 n: usize) -> c_int;
+
 //TODO secp256k1_ec_privkey_export
 //TODO secp256k1_ec_privkey_import
 
@@ -255,7 +413,7 @@ extern "C" {
     pub fn secp256k1_ec_pubkey_combine(cx: *const Context,
                                        out: *mut PublicKey,
                                        ins: *const *const PublicKey,
-                                       n: c_int)
+                                       n: usize)
                                        -> c_int;
 
     pub fn secp256k1_ecdh(cx: *const Context,
@@ -272,6 +430,37 @@ extern "C" {
                               scalar: *const c_uchar)
                               -> c_int;
 
+    pub fn secp256k1_ext_ecdh_raw_batch(cx: *const Context,
+                                        out: *mut SharedSecret,
+                                        points: *const *const PublicKey,
+                                        scalars: *const *const c_uchar,
+                                        n: usize)
+                                        -> c_int;
+
+    pub fn secp256k1_ext_precomputed_point_build(cx: *const Context,
+                                                 table: *mut PrecomputedPoint,
+                                                 point: *const PublicKey)
+                                                 -> c_int;
+
+    pub fn secp256k1_ext_ecdh_precomputed(cx: *const Context,
+                                          out: *mut SharedSecret,
+                                          table: *const PrecomputedPoint,
+                                          scalar: *const c_uchar,
+                                          hash_fn: EcdhHashFn,
+                                          data: *mut c_void)
+                                          -> c_int;
+
+    pub fn secp256k1_ext_ecdh_precomputed_raw(cx: *const Context,
+                                              out: *mut SharedSecret,
+                                              table: *const PrecomputedPoint,
+                                              scalar: *const c_uchar)
+                                              -> c_int;
+
+    pub fn secp256k1_ext_ec_privkey_inverse_batch(cx: *const Context,
+                                                  sks: *mut c_uchar,
+                                                  n: usize)
+                                                  -> c_int;
+
     pub fn secp256k1_ec_privkey_inverse(cx: *const Context,
                           out: *mut c_uchar,
                           scalar: *const c_uchar)
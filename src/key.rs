@@ -15,6 +15,8 @@
 
 //! # Public and secret keys
 
+use std::os::raw::c_int;
+
 use arrayvec::ArrayVec;
 use rand::RngCore;
 
@@ -61,9 +63,83 @@ pub const MINUS_ONE_KEY: SecretKey = SecretKey([0xff, 0xff, 0xff, 0xff, 0xff, 0x
                                                 0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x40]);
 
 /// A Secp256k1 public key, used for verification of signatures
+#[repr(C)]
 #[derive(Copy, Clone, PartialEq, Eq, Debug, Hash)]
 pub struct PublicKey(ffi::PublicKey);
 
+/// A borrowed, unparsed serialized public key (33 or 65 bytes), e.g. pointing
+/// into a network buffer. Only the length is checked on construction; the
+/// key is parsed inside the FFI call which uses it (`Secp256k1::verify_ref`),
+/// without first being copied into a `PublicKey`.
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub struct PubkeyRef<'a>(&'a [u8]);
+
+impl<'a> PubkeyRef<'a> {
+    /// Borrows a compressed or uncompressed serialized public key
+    #[inline]
+    pub fn new(data: &'a [u8]) -> Result<PubkeyRef<'a>, Error> {
+        match data.len() {
+            constants::COMPRESSED_PUBLIC_KEY_SIZE | constants::UNCOMPRESSED_PUBLIC_KEY_SIZE => Ok(PubkeyRef(data)),
+            _ => Err(InvalidPublicKey)
+        }
+    }
+
+    /// Parses the key into an owned `PublicKey`
+    #[inline]
+    pub fn parse(&self, secp: &Secp256k1) -> Result<PublicKey, Error> {
+        PublicKey::from_slice(secp, self.0)
+    }
+
+    /// The serialized key
+    #[inline]
+    pub fn as_slice(&self) -> &'a [u8] {
+        self.0
+    }
+
+    /// Obtains a raw pointer to the serialized key
+    #[inline]
+    pub fn as_ptr(&self) -> *const u8 {
+        self.0.as_ptr()
+    }
+}
+
+/// A public key serialization format, chosen at compile time by
+/// `PublicKey::serialize_batch`. Implemented by `Compressed` and `Uncompressed`.
+pub trait PublicKeyFormat {
+    /// The size (in bytes) of one serialized key
+    const SIZE: usize;
+
+    #[doc(hidden)]
+    unsafe fn serialize_raw(cx: *const ffi::Context, output: *mut u8,
+                            pks: *const ffi::PublicKey, n: usize) -> c_int;
+}
+
+/// Compressed (33-byte) public key serialization
+pub enum Compressed {}
+
+/// Uncompressed (65-byte) public key serialization
+pub enum Uncompressed {}
+
+impl PublicKeyFormat for Compressed {
+    const SIZE: usize = constants::COMPRESSED_PUBLIC_KEY_SIZE;
+
+    #[inline]
+    unsafe fn serialize_raw(cx: *const ffi::Context, output: *mut u8,
+                            pks: *const ffi::PublicKey, n: usize) -> c_int {
+        ffi::secp256k1_ext_pubkey_serialize_compressed_batch(cx, output, pks, n)
+    }
+}
+
+impl PublicKeyFormat for Uncompressed {
+    const SIZE: usize = constants::UNCOMPRESSED_PUBLIC_KEY_SIZE;
+
+    #[inline]
+    unsafe fn serialize_raw(cx: *const ffi::Context, output: *mut u8,
+                            pks: *const ffi::PublicKey, n: usize) -> c_int {
+        ffi::secp256k1_ext_pubkey_serialize_uncompressed_batch(cx, output, pks, n)
+    }
+}
+
 fn random_32_bytes<R: RngCore>(rng: &mut R) -> [u8; 32] {
     let mut ret = [0u8; 32];
     rng.fill_bytes(&mut ret);
@@ -87,6 +163,7 @@ impl SecretKey {
     #[inline]
     pub fn from_slice(secp: &Secp256k1, data: &[u8])
                         -> Result<SecretKey, Error> {
+        metrics_timer!(secp, Parse);
         match data.len() {
             constants::SECRET_KEY_SIZE => {
                 let mut ret = [0; constants::SECRET_KEY_SIZE];
@@ -106,6 +183,7 @@ impl SecretKey {
     /// Adds one secret key to another, modulo the curve order
     pub fn add_assign(&mut self, secp: &Secp256k1, other: &SecretKey)
                      -> Result<(), Error> {
+        metrics_timer!(secp, Tweak);
         unsafe {
             if ffi::secp256k1_ec_privkey_tweak_add(secp.ctx, self.as_mut_ptr(), other.as_ptr()) != 1 {
                 Err(InvalidSecretKey)
@@ -119,6 +197,7 @@ impl SecretKey {
     /// Multiplies one secret key by another, modulo the curve order
     pub fn mul_assign(&mut self, secp: &Secp256k1, other: &SecretKey)
                      -> Result<(), Error> {
+        metrics_timer!(secp, Tweak);
         unsafe {
             if ffi::secp256k1_ec_privkey_tweak_mul(secp.ctx, self.as_mut_ptr(), other.as_ptr()) != 1 {
                 Err(InvalidSecretKey)
@@ -131,9 +210,30 @@ impl SecretKey {
     #[inline]
     /// Inverts (1 / self) this secret key.
     pub fn inv_assign(&mut self, secp: &Secp256k1) -> Result<(), Error> {
-        let original = self.clone();
+        metrics_timer!(secp, Tweak);
         unsafe {
-            if ffi::secp256k1_ec_privkey_inverse(secp.ctx, self.as_mut_ptr(), original.as_ptr()) != 1 {
+            // The C side reads the key before writing the result, so it may
+            // invert in place
+            let key = self.as_mut_ptr();
+            if ffi::secp256k1_ec_privkey_inverse(secp.ctx, key, key) != 1 {
+                Err(InvalidSecretKey)
+            } else {
+                Ok(())
+            }
+        }
+    }
+
+    /// Inverts every key of `keys` in place, with a single scalar inversion
+    /// and three multiplications per key (Montgomery's trick) instead of one
+    /// inversion per key. Constant time like `inv_assign`.
+    pub fn inv_batch(secp: &Secp256k1, keys: &mut [SecretKey]) -> Result<(), Error> {
+        metrics_timer!(secp, Tweak, keys.len());
+        metrics_span!("inv_batch", keys.len());
+        unsafe {
+            // `SecretKey` is a `repr(C)` wrapper, so the slice is an array of
+            // 32-byte keys
+            if ffi::secp256k1_ext_ec_privkey_inverse_batch(secp.ctx, keys.as_mut_ptr() as *mut u8,
+                                                           keys.len()) != 1 {
                 Err(InvalidSecretKey)
             } else {
                 Ok(())
@@ -168,6 +268,7 @@ impl PublicKey {
     pub fn from_secret_key(secp: &Secp256k1,
                            sk: &SecretKey)
                            -> Result<PublicKey, Error> {
+        metrics_timer!(secp, Keygen);
         if secp.caps == ContextFlag::VerifyOnly || secp.caps == ContextFlag::None {
             return Err(IncapableContext);
         }
@@ -181,11 +282,41 @@ impl PublicKey {
         Ok(PublicKey(pk))
     }
 
+    /// Creates the public keys of `sks`, writing the key for `sks[i]` to
+    /// `output[i]`. Equivalent to calling `from_secret_key` on every key, but
+    /// the conversions to affine coordinates share one field inversion per
+    /// `ffi::SECP256K1_EXT_BATCH_MAX` keys. Requires a signing-capable context.
+    ///
+    /// Panics if `sks` and `output` differ in length.
+    pub fn from_secret_keys(secp: &Secp256k1, sks: &[SecretKey], output: &mut [PublicKey])
+                            -> Result<(), Error> {
+        metrics_timer!(secp, Keygen, sks.len());
+        metrics_span!("from_secret_keys", sks.len());
+        if secp.caps == ContextFlag::VerifyOnly || secp.caps == ContextFlag::None {
+            return Err(IncapableContext);
+        }
+        assert_eq!(sks.len(), output.len(), "from_secret_keys: input and output lengths differ");
+
+        for (sks, output) in sks.chunks(ffi::SECP256K1_EXT_BATCH_MAX)
+                                .zip(output.chunks_mut(ffi::SECP256K1_EXT_BATCH_MAX)) {
+            unsafe {
+                // Both types are `repr(C)` wrappers, so the slices are plain
+                // arrays of 32-byte keys and of `ffi::PublicKey`
+                let res = ffi::secp256k1_ext_ec_pubkey_create_batch(secp.ctx,
+                                                                    output.as_mut_ptr() as *mut ffi::PublicKey,
+                                                                    sks.as_ptr() as *const u8, sks.len());
+                // As in `from_secret_key`, a `SecretKey` is always valid
+                debug_assert_eq!(res, 1);
+            }
+        }
+        Ok(())
+    }
+
     /// Creates a public key directly from a slice
     #[inline]
     pub fn from_slice(secp: &Secp256k1, data: &[u8])
                       -> Result<PublicKey, Error> {
-
+        metrics_timer!(secp, Parse);
         let mut pk = unsafe { ffi::PublicKey::blank() };
         unsafe {
             if ffi::secp256k1_ec_pubkey_parse(secp.ctx, &mut pk, data.as_ptr(),
@@ -202,6 +333,7 @@ impl PublicKey {
     /// the y-coordinate is represented by only a single bit, as x determines
     /// it up to one bit.
     pub fn serialize_vec(&self, secp: &Secp256k1, compressed: bool) -> ArrayVec<[u8; constants::PUBLIC_KEY_SIZE]> {
+        metrics_timer!(secp, Serialize);
         let mut ret = ArrayVec::new();
 
         unsafe {
@@ -216,10 +348,60 @@ impl PublicKey {
         ret
     }
 
+    #[inline]
+    /// Serializes the key in uncompressed form into `output`, without the
+    /// length bookkeeping of `serialize_vec`. The key must be valid.
+    pub fn serialize_into(&self, secp: &Secp256k1,
+                          output: &mut [u8; constants::UNCOMPRESSED_PUBLIC_KEY_SIZE]) {
+        metrics_timer!(secp, Serialize);
+        debug_assert!(self.is_valid());
+        unsafe {
+            let res = Uncompressed::serialize_raw(secp.ctx, output.as_mut_ptr(), self.as_ptr(), 1);
+            debug_assert_eq!(res, 1);
+        }
+    }
+
+    #[inline]
+    /// Serializes the key in compressed form into `output`. The key must be
+    /// valid.
+    pub fn serialize_compressed_into(&self, secp: &Secp256k1,
+                                     output: &mut [u8; constants::COMPRESSED_PUBLIC_KEY_SIZE]) {
+        metrics_timer!(secp, Serialize);
+        debug_assert!(self.is_valid());
+        unsafe {
+            let res = Compressed::serialize_raw(secp.ctx, output.as_mut_ptr(), self.as_ptr(), 1);
+            debug_assert_eq!(res, 1);
+        }
+    }
+
+    /// Serializes `keys` back to back into `output` in the format `F`, key `i`
+    /// at `output[i * F::SIZE..(i + 1) * F::SIZE]`, with a single FFI call.
+    /// Fails with `InvalidPublicKey`, writing nothing, if any key is invalid.
+    ///
+    /// Panics unless `output.len() == keys.len() * F::SIZE`.
+    pub fn serialize_batch<F: PublicKeyFormat>(secp: &Secp256k1, keys: &[PublicKey], output: &mut [u8])
+                                               -> Result<(), Error> {
+        metrics_timer!(secp, Serialize, keys.len());
+        metrics_span!("serialize_batch", keys.len());
+        assert_eq!(output.len(), keys.len() * F::SIZE, "serialize_batch: output has the wrong length");
+        if keys.iter().any(|pk| !pk.is_valid()) {
+            return Err(InvalidPublicKey);
+        }
+        unsafe {
+            // `PublicKey` is a `repr(C)` wrapper, so the slice is an array
+            // of `ffi::PublicKey`
+            let res = F::serialize_raw(secp.ctx, output.as_mut_ptr(),
+                                       keys.as_ptr() as *const ffi::PublicKey, keys.len());
+            debug_assert_eq!(res, 1);
+        }
+        Ok(())
+    }
+
     #[inline]
     /// Adds the pk corresponding to `other` to the pk `self` in place
     pub fn add_exp_assign(&mut self, secp: &Secp256k1, other: &SecretKey)
                          -> Result<(), Error> {
+        metrics_timer!(secp, Tweak);
         if secp.caps == ContextFlag::SignOnly || secp.caps == ContextFlag::None {
             return Err(IncapableContext);
         }
@@ -236,6 +418,7 @@ impl PublicKey {
     #[inline]
     /// Adds another point on the curve in place
     pub fn add_assign(&mut self, secp: &Secp256k1, other: &PublicKey) -> Result<(), Error> {
+        metrics_timer!(secp, Tweak);
         let mut public = ffi::PublicKey::new();
         let res = unsafe {
             if ffi::secp256k1_ec_pubkey_combine(
@@ -256,6 +439,7 @@ impl PublicKey {
     #[inline]
     /// Multiplies this point by `secret` scalar
     pub fn mul_assign(&mut self, secp: &Secp256k1, other: &SecretKey) -> Result<(), Error> {
+        metrics_timer!(secp, Tweak);
         if secp.caps == ContextFlag::SignOnly || secp.caps == ContextFlag::None {
             return Err(IncapableContext);
         }
@@ -268,6 +452,113 @@ impl PublicKey {
             }
         }
     }
+
+    /// Adds up `keys` with a single affine conversion at the end, where calling
+    /// `add_assign` repeatedly would convert (and invert) after every step.
+    /// Constant time like `add_assign`. Fails with `InvalidPublicKey` if `keys`
+    /// is empty, contains an invalid key, or sums to the point at infinity.
+    pub fn combine(secp: &Secp256k1, keys: &[&PublicKey]) -> Result<PublicKey, Error> {
+        metrics_timer!(secp, Combine);
+        if keys.is_empty() || keys.iter().any(|pk| !pk.is_valid()) {
+            return Err(InvalidPublicKey);
+        }
+        let mut sum = ffi::PublicKey::new();
+        unsafe {
+            // `PublicKey` is a `repr(C)` wrapper, so `&PublicKey` has the
+            // representation of `*const ffi::PublicKey`
+            if ffi::secp256k1_ec_pubkey_combine(secp.ctx, &mut sum,
+                                                keys.as_ptr() as *const *const ffi::PublicKey,
+                                                keys.len()) == 1 {
+                Ok(PublicKey(sum))
+            } else {
+                Err(InvalidPublicKey)
+            }
+        }
+    }
+
+    // Variable-time operations. These leak their inputs through timing and
+    // are for public data only, such as keys and tweaks seen on chain.
+
+    #[inline]
+    /// Variable-time version of `mul_assign`, for public `self` and `other`
+    /// only. Uses a variable-time affine conversion and, unlike `mul_assign`,
+    /// works with a context of any capabilities.
+    pub fn mul_assign_vartime(&mut self, secp: &Secp256k1, other: &SecretKey) -> Result<(), Error> {
+        metrics_timer!(secp, Tweak);
+        if !self.is_valid() {
+            return Err(InvalidPublicKey);
+        }
+        unsafe {
+            if ffi::secp256k1_ext_ec_pubkey_tweak_mul_var(secp.ctx, &mut self.0 as *mut _,
+                                                          other.as_ptr()) == 1 {
+                Ok(())
+            } else {
+                Err(InvalidSecretKey)
+            }
+        }
+    }
+
+    #[inline]
+    /// Variable-time version of `add_assign`, for public keys only
+    pub fn add_assign_vartime(&mut self, secp: &Secp256k1, other: &PublicKey) -> Result<(), Error> {
+        metrics_timer!(secp, Tweak);
+        let sum = try!(PublicKey::combine_vartime(secp, &[*self, *other]));
+        *self = sum;
+        Ok(())
+    }
+
+    /// Adds up `keys` in variable time, for public keys only. Fails with
+    /// `InvalidPublicKey` if `keys` is empty, contains an invalid key, or sums
+    /// to the point at infinity.
+    pub fn combine_vartime(secp: &Secp256k1, keys: &[PublicKey]) -> Result<PublicKey, Error> {
+        metrics_timer!(secp, Combine);
+        metrics_span!("combine_vartime", keys.len());
+        if keys.is_empty() || keys.iter().any(|pk| !pk.is_valid()) {
+            return Err(InvalidPublicKey);
+        }
+        let mut sum = ffi::PublicKey::new();
+        unsafe {
+            // `PublicKey` is a `repr(C)` wrapper, so the slice is an array
+            // of `ffi::PublicKey`
+            if ffi::secp256k1_ext_ec_pubkey_combine_var(secp.ctx, &mut sum,
+                                                        keys.as_ptr() as *const ffi::PublicKey,
+                                                        keys.len()) == 1 {
+                Ok(PublicKey(sum))
+            } else {
+                Err(InvalidPublicKey)
+            }
+        }
+    }
+
+    /// Computes `sum(scalars[i] * keys[i])` in variable time, for public data
+    /// only, with one multi-scalar multiplication (Strauss or Pippenger) and a
+    /// single affine conversion at the end. Works with a context of any
+    /// capabilities. Fails with `InvalidPublicKey` if `keys` is empty, contains
+    /// an invalid key, or the sum is the point at infinity.
+    ///
+    /// Panics if `keys` and `scalars` differ in length.
+    pub fn mul_sum_vartime(secp: &Secp256k1, keys: &[PublicKey], scalars: &[SecretKey])
+                           -> Result<PublicKey, Error> {
+        metrics_timer!(secp, Combine);
+        metrics_span!("mul_sum_vartime", keys.len());
+        assert_eq!(keys.len(), scalars.len(), "mul_sum_vartime: keys and scalars differ in length");
+        if keys.is_empty() || keys.iter().any(|pk| !pk.is_valid()) {
+            return Err(InvalidPublicKey);
+        }
+        let mut sum = ffi::PublicKey::new();
+        unsafe {
+            // Both types are `repr(C)` wrappers, so the slices are plain
+            // arrays of `ffi::PublicKey` and of 32-byte scalars
+            if ffi::secp256k1_ext_ec_pubkey_multi_mul_var(secp.ctx, &mut sum,
+                                                          keys.as_ptr() as *const ffi::PublicKey,
+                                                          scalars.as_ptr() as *const u8,
+                                                          keys.len()) == 1 {
+                Ok(PublicKey(sum))
+            } else {
+                Err(InvalidPublicKey)
+            }
+        }
+    }
 }
 
 /// Creates a new public key from a FFI public key
@@ -278,11 +569,79 @@ impl From<ffi::PublicKey> for PublicKey {
     }
 }
 
+/// An iterator over the public keys of `start`, `start + step`,
+/// `start + 2 * step`, ... Each key costs one group addition instead of a
+/// full multiplication, and the keys are converted to affine coordinates in
+/// batches of `ffi::SECP256K1_EXT_BATCH_MAX` sharing one field inversion.
+///
+/// The additions are variable time, so the stream is meant for public
+/// enumerations such as address scans and test vectors. It ends if a
+/// secret key in the sequence would be zero.
+pub struct PublicKeyStream<'a> {
+    secp: &'a Secp256k1,
+    step: PublicKey,
+    buf: [PublicKey; ffi::SECP256K1_EXT_BATCH_MAX],
+    pos: usize,
+    len: usize,
+    done: bool
+}
+
+impl<'a> PublicKeyStream<'a> {
+    /// Creates a stream starting at the public key of `start`, with the
+    /// secret key growing by `step` each time. Requires a signing-capable
+    /// context.
+    pub fn new(secp: &'a Secp256k1, start: &SecretKey, step: &SecretKey)
+               -> Result<PublicKeyStream<'a>, Error> {
+        let mut buf = [PublicKey::new(); ffi::SECP256K1_EXT_BATCH_MAX];
+        buf[0] = try!(PublicKey::from_secret_key(secp, start));
+        Ok(PublicKeyStream {
+            secp: secp,
+            step: try!(PublicKey::from_secret_key(secp, step)),
+            buf: buf,
+            pos: 0,
+            len: 1,
+            done: false
+        })
+    }
+
+    // Refills the buffer with the keys following its last one
+    fn refill(&mut self) {
+        let last = self.buf[self.len - 1];
+        let n = unsafe {
+            ffi::secp256k1_ext_ec_pubkey_stream(self.secp.ctx, self.buf.as_mut_ptr() as *mut ffi::PublicKey,
+                                                last.as_ptr(), self.step.as_ptr(), self.buf.len())
+        } as usize;
+        // A short batch means the sum reached infinity
+        self.done = n < self.buf.len();
+        self.pos = 0;
+        self.len = n;
+    }
+}
+
+impl<'a> Iterator for PublicKeyStream<'a> {
+    type Item = PublicKey;
+
+    #[inline]
+    fn next(&mut self) -> Option<PublicKey> {
+        if self.pos == self.len {
+            if self.done {
+                return None;
+            }
+            self.refill();
+            if self.pos == self.len {
+                return None;
+            }
+        }
+        self.pos += 1;
+        Some(self.buf[self.pos - 1])
+    }
+}
+
 #[cfg(test)]
 mod test {
     use super::super::{Secp256k1, ContextFlag};
     use super::super::Error::{InvalidPublicKey, InvalidSecretKey, IncapableContext};
-    use super::{PublicKey, SecretKey};
+    use super::{PublicKey, SecretKey, PublicKeyStream, Compressed, Uncompressed, ONE_KEY, MINUS_ONE_KEY};
     use super::super::constants;
 
     use rand::{RngCore, thread_rng};
@@ -463,6 +822,84 @@ mod test {
                    &[2, 149, 16, 196, 140, 38, 92, 239, 179, 65, 59, 224, 230, 183, 91, 238, 240, 46, 186, 252, 175, 102, 52, 249, 98, 178, 123, 72, 50, 171, 196, 254, 236][..]);
     }
 
+    #[test]
+    fn test_pubkey_serialize_into() {
+        let s = Secp256k1::new();
+
+        let mut keys = Vec::new();
+        for _ in 0..10 {
+            let (_, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+            keys.push(pk);
+        }
+
+        let mut compressed = vec![0; keys.len() * constants::COMPRESSED_PUBLIC_KEY_SIZE];
+        let mut uncompressed = vec![0; keys.len() * constants::UNCOMPRESSED_PUBLIC_KEY_SIZE];
+        assert!(PublicKey::serialize_batch::<Compressed>(&s, &keys, &mut compressed).is_ok());
+        assert!(PublicKey::serialize_batch::<Uncompressed>(&s, &keys, &mut uncompressed).is_ok());
+
+        for (i, pk) in keys.iter().enumerate() {
+            let mut out33 = [0; constants::COMPRESSED_PUBLIC_KEY_SIZE];
+            let mut out65 = [0; constants::UNCOMPRESSED_PUBLIC_KEY_SIZE];
+            pk.serialize_compressed_into(&s, &mut out33);
+            pk.serialize_into(&s, &mut out65);
+            assert_eq!(&out33[..], &pk.serialize_vec(&s, true)[..]);
+            assert_eq!(&out65[..], &pk.serialize_vec(&s, false)[..]);
+            assert_eq!(&compressed[i * 33..(i + 1) * 33], &out33[..]);
+            assert_eq!(&uncompressed[i * 65..(i + 1) * 65], &out65[..]);
+        }
+
+        assert!(PublicKey::serialize_batch::<Compressed>(&s, &[], &mut []).is_ok());
+        keys[4] = PublicKey::new();
+        assert_eq!(PublicKey::serialize_batch::<Compressed>(&s, &keys, &mut compressed), Err(InvalidPublicKey));
+    }
+
+    #[test]
+    fn pubkeys_from_secret_keys() {
+        let s = Secp256k1::new();
+
+        let mut sks = Vec::new();
+        let mut expected = Vec::new();
+        for _ in 0..150 {
+            let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+            sks.push(sk);
+            expected.push(pk);
+        }
+        let mut output = vec![PublicKey::new(); sks.len()];
+        assert_eq!(PublicKey::from_secret_keys(&s, &sks, &mut output), Ok(()));
+        assert_eq!(output, expected);
+        assert_eq!(PublicKey::from_secret_keys(&s, &[], &mut []), Ok(()));
+
+        let vrfy = Secp256k1::with_caps(ContextFlag::VerifyOnly);
+        assert_eq!(PublicKey::from_secret_keys(&vrfy, &sks, &mut output), Err(IncapableContext));
+    }
+
+    #[test]
+    fn pubkey_stream() {
+        let s = Secp256k1::new();
+
+        for &step in [ONE_KEY, SecretKey::new(&s, &mut thread_rng())].iter() {
+            let mut sk = SecretKey::new(&s, &mut thread_rng());
+            let stream = PublicKeyStream::new(&s, &sk, &step).unwrap();
+            for pk in stream.take(200) {
+                assert_eq!(pk, PublicKey::from_secret_key(&s, &sk).unwrap());
+                sk.add_assign(&s, &step).unwrap();
+            }
+        }
+
+        // The stream ends before the secret key wraps around to zero
+        let start = SecretKey::from_slice(&s, &[0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+                                                0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b,
+                                                0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x40, 0xf0]).unwrap();
+        let mut stream = PublicKeyStream::new(&s, &start, &ONE_KEY).unwrap();
+        assert_eq!(stream.by_ref().count(), 0x4141 - 0x40f0);
+        assert_eq!(stream.next(), None);
+        assert_eq!(stream.last(), None);
+
+        let vrfy = Secp256k1::with_caps(ContextFlag::VerifyOnly);
+        assert!(PublicKeyStream::new(&vrfy, &start, &ONE_KEY).is_err());
+    }
+
     #[test]
     fn test_addition() {
         let s = Secp256k1::new();
@@ -499,6 +936,101 @@ mod test {
         assert_eq!(PublicKey::from_secret_key(&s, &sk2).unwrap(), pk2);
     }
 
+    #[test]
+    fn pubkey_vartime() {
+        let s = Secp256k1::new();
+        let none = Secp256k1::without_caps();
+
+        let (_, pk1) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let (sk2, pk2) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let (_, pk3) = s.generate_keypair(&mut thread_rng()).unwrap();
+
+        let mut expected = pk1;
+        expected.mul_assign(&s, &sk2).unwrap();
+        let mut prod = pk1;
+        assert_eq!(prod.mul_assign_vartime(&none, &sk2), Ok(()));
+        assert_eq!(prod, expected);
+
+        let mut expected = pk1;
+        expected.add_assign(&s, &pk2).unwrap();
+        let mut sum = pk1;
+        assert_eq!(sum.add_assign_vartime(&none, &pk2), Ok(()));
+        assert_eq!(sum, expected);
+        expected.add_assign(&s, &pk3).unwrap();
+        assert_eq!(PublicKey::combine_vartime(&none, &[pk1, pk2, pk3]), Ok(expected));
+        assert_eq!(PublicKey::combine_vartime(&none, &[pk1]), Ok(pk1));
+
+        // P + (-P) is the point at infinity
+        let mut minus_pk1 = pk1;
+        minus_pk1.mul_assign_vartime(&none, &MINUS_ONE_KEY).unwrap();
+        assert_eq!(PublicKey::combine_vartime(&none, &[pk1, minus_pk1]), Err(InvalidPublicKey));
+        assert_eq!(PublicKey::combine_vartime(&none, &[]), Err(InvalidPublicKey));
+        assert_eq!(PublicKey::combine_vartime(&none, &[pk1, PublicKey::new()]), Err(InvalidPublicKey));
+        assert_eq!(PublicKey::new().mul_assign_vartime(&none, &sk2), Err(InvalidPublicKey));
+    }
+
+    #[test]
+    fn pubkey_combine_many() {
+        let s = Secp256k1::new();
+        let none = Secp256k1::without_caps();
+
+        let mut keys = Vec::new();
+        let mut scalars = Vec::new();
+        for _ in 0..40 {
+            keys.push(s.generate_keypair(&mut thread_rng()).unwrap().1);
+            scalars.push(SecretKey::new(&s, &mut thread_rng()));
+        }
+
+        let mut expected = keys[0];
+        for pk in &keys[1..] {
+            expected.add_assign(&s, pk).unwrap();
+        }
+        let refs: Vec<&PublicKey> = keys.iter().collect();
+        assert_eq!(PublicKey::combine(&none, &refs), Ok(expected));
+        assert_eq!(PublicKey::combine(&none, &refs[..1]), Ok(keys[0]));
+        assert_eq!(PublicKey::combine(&none, &[]), Err(InvalidPublicKey));
+
+        let mut expected = PublicKey::new();
+        for (i, (pk, k)) in keys.iter().zip(scalars.iter()).enumerate() {
+            let mut term = *pk;
+            term.mul_assign(&s, k).unwrap();
+            if i == 0 {
+                expected = term;
+            } else {
+                expected.add_assign(&s, &term).unwrap();
+            }
+        }
+        assert_eq!(PublicKey::mul_sum_vartime(&none, &keys, &scalars), Ok(expected));
+        assert_eq!(PublicKey::mul_sum_vartime(&none, &keys[..1], &[ONE_KEY]), Ok(keys[0]));
+
+        // k P + (-k) P is the point at infinity
+        let mut minus = scalars[0];
+        minus.mul_assign(&s, &MINUS_ONE_KEY).unwrap();
+        assert_eq!(PublicKey::mul_sum_vartime(&none, &[keys[0], keys[0]], &[scalars[0], minus]),
+                   Err(InvalidPublicKey));
+        assert_eq!(PublicKey::mul_sum_vartime(&none, &[], &[]), Err(InvalidPublicKey));
+    }
+
+    #[test]
+    fn skey_inv_batch() {
+        let s = Secp256k1::new();
+
+        for &n in [1, 2, 3, 100].iter() {
+            let keys: Vec<_> = (0..n).map(|_| SecretKey::new(&s, &mut thread_rng())).collect();
+            let mut inverses = keys.clone();
+            assert_eq!(SecretKey::inv_batch(&s, &mut inverses), Ok(()));
+            for (key, inv) in keys.iter().zip(inverses.iter()) {
+                let mut expected = *key;
+                expected.inv_assign(&s).unwrap();
+                assert_eq!(*inv, expected);
+                let mut one = *key;
+                one.mul_assign(&s, inv).unwrap();
+                assert_eq!(one, ONE_KEY);
+            }
+        }
+        assert_eq!(SecretKey::inv_batch(&s, &mut []), Ok(()));
+    }
+
     #[test]
     fn pubkey_hash() {
         use std::collections::hash_map::DefaultHasher;
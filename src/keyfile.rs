@@ -0,0 +1,393 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Public key files
+//! A file format for large sets of public keys which loads without parsing
+//! the keys. The keys are stored in their internal (parsed) representation,
+//! so a file is only readable by builds with the same representation, which
+//! the header records.
+//!
+//! Layout, integers little-endian:
+//!
+//! | offset | size | contents                                            |
+//! |--------|------|-----------------------------------------------------|
+//! | 0      | 8    | magic, `SECPKEYS`                                   |
+//! | 8      | 4    | format version, `VERSION`                           |
+//! | 12     | 4    | zero                                                |
+//! | 16     | 8    | number of keys `n`                                  |
+//! | 24     | 64   | internal representation of the generator            |
+//! | 88     | 32   | SHA256 of the keys                                  |
+//! | 120    | 32   | SHA256 of bytes 0 to 120                            |
+//! | 152    | 104  | zero                                                |
+//! | 256    | 64 n | the keys                                            |
+//!
+
+use std::{error, fmt, io, slice};
+use std::io::Write;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+use super::Secp256k1;
+use super::Error::{self, InvalidPublicKey};
+use key::PublicKey;
+use constants;
+use ffi;
+
+/// The file magic
+pub const MAGIC: [u8; 8] = *b"SECPKEYS";
+
+/// The format version written by `write`, and the only one `KeySet` reads
+pub const VERSION: u32 = 1;
+
+/// The size (in bytes) of the header; the keys follow it
+pub const HEADER_SIZE: usize = 256;
+
+const KEY_SIZE: usize = 64;
+
+/// An error loading a public key file
+#[derive(Debug)]
+pub enum KeyFileError {
+    /// Reading or writing the file failed
+    Io(io::Error),
+    /// The data does not start with `MAGIC`
+    BadMagic,
+    /// The file has a format version other than `VERSION`
+    UnsupportedVersion(u32),
+    /// The file was written by a build with a different key representation
+    IncompatibleBuild,
+    /// The header checksum does not match
+    CorruptHeader,
+    /// The size of the data does not match the number of keys in the header
+    WrongLength,
+    /// The checksum of the keys does not match
+    CorruptKeys,
+    /// The key at this index is invalid
+    InvalidKey(usize)
+}
+
+impl fmt::Display for KeyFileError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        match *self {
+            KeyFileError::Io(ref e) => write!(f, "key file: {}", e),
+            KeyFileError::UnsupportedVersion(v) => write!(f, "key file: unsupported version {}", v),
+            KeyFileError::InvalidKey(i) => write!(f, "key file: invalid key at index {}", i),
+            _ => f.write_str(error::Error::description(self))
+        }
+    }
+}
+
+impl error::Error for KeyFileError {
+    fn description(&self) -> &str {
+        match *self {
+            KeyFileError::Io(_) => "key file: I/O error",
+            KeyFileError::BadMagic => "key file: bad magic",
+            KeyFileError::UnsupportedVersion(_) => "key file: unsupported version",
+            KeyFileError::IncompatibleBuild => "key file: written by an incompatible build",
+            KeyFileError::CorruptHeader => "key file: header checksum mismatch",
+            KeyFileError::WrongLength => "key file: length does not match the header",
+            KeyFileError::CorruptKeys => "key file: key checksum mismatch",
+            KeyFileError::InvalidKey(_) => "key file: invalid key"
+        }
+    }
+}
+
+impl From<io::Error> for KeyFileError {
+    fn from(e: io::Error) -> KeyFileError {
+        KeyFileError::Io(e)
+    }
+}
+
+fn sha256(data: &[u8]) -> [u8; 32] {
+    let mut hash = [0; 32];
+    unsafe { ffi::secp256k1_ext_sha256(hash.as_mut_ptr(), data.as_ptr(), data.len()); }
+    hash
+}
+
+fn keys_as_bytes(keys: &[PublicKey]) -> &[u8] {
+    // `PublicKey` is a `repr(C)` wrapper of 64 bytes with alignment 1
+    unsafe { slice::from_raw_parts(keys.as_ptr() as *const u8, keys.len() * KEY_SIZE) }
+}
+
+// The generator in the internal representation of this build
+fn generator_repr(secp: &Secp256k1) -> [u8; KEY_SIZE] {
+    let mut compressed = [2; constants::COMPRESSED_PUBLIC_KEY_SIZE];
+    compressed[1..].copy_from_slice(&constants::GENERATOR_X);
+    let g = PublicKey::from_slice(secp, &compressed).expect("the generator is a valid key; qed");
+    let mut repr = [0; KEY_SIZE];
+    repr.copy_from_slice(keys_as_bytes(&[g]));
+    repr
+}
+
+fn put_u32(buf: &mut [u8], value: u32) {
+    for (i, byte) in buf[..4].iter_mut().enumerate() {
+        *byte = (value >> (8 * i)) as u8;
+    }
+}
+
+fn put_u64(buf: &mut [u8], value: u64) {
+    for (i, byte) in buf[..8].iter_mut().enumerate() {
+        *byte = (value >> (8 * i)) as u8;
+    }
+}
+
+fn get_u32(buf: &[u8]) -> u32 {
+    buf[..4].iter().rev().fold(0, |acc, &byte| (acc << 8) | byte as u32)
+}
+
+fn get_u64(buf: &[u8]) -> u64 {
+    buf[..8].iter().rev().fold(0, |acc, &byte| (acc << 8) | byte as u64)
+}
+
+/// Writes `keys` to `w` in the key file format. Fails with
+/// `KeyFileError::InvalidKey` before writing anything if a key is invalid.
+pub fn write<W: Write>(secp: &Secp256k1, w: &mut W, keys: &[PublicKey]) -> Result<(), KeyFileError> {
+    if let Some(i) = keys.iter().position(|pk| !pk.is_valid()) {
+        return Err(KeyFileError::InvalidKey(i));
+    }
+    let payload = keys_as_bytes(keys);
+
+    let mut header = [0; HEADER_SIZE];
+    header[..8].copy_from_slice(&MAGIC);
+    put_u32(&mut header[8..], VERSION);
+    put_u64(&mut header[16..], keys.len() as u64);
+    header[24..88].copy_from_slice(&generator_repr(secp));
+    header[88..120].copy_from_slice(&sha256(payload));
+    let checksum = sha256(&header[..120]);
+    header[120..152].copy_from_slice(&checksum);
+
+    try!(w.write_all(&header));
+    try!(w.write_all(payload));
+    Ok(())
+}
+
+/// The keys of a key file, borrowed from its contents without copying or
+/// parsing them, for example from a memory mapping of the file.
+///
+/// Opening checks the header, but neither the checksum of the keys (see
+/// `verify_checksum`) nor the keys themselves: `get` checks a key the first
+/// time it is requested, and `check_all` checks all those not yet checked, for
+/// example on a background thread while the node starts. `keys` hands out all
+/// of them once they are checked.
+pub struct KeySet<'a> {
+    keys: &'a [PublicKey],
+    payload: &'a [u8],
+    // The checksum of the payload from the header
+    checksum: &'a [u8],
+    // One bit per key, set once the key is known to be valid
+    checked: Vec<AtomicUsize>
+}
+
+const BITS: usize = 8 * ::std::mem::size_of::<usize>();
+
+impl<'a> KeySet<'a> {
+    /// Opens the contents `data` of a key file
+    pub fn from_bytes(secp: &Secp256k1, data: &'a [u8]) -> Result<KeySet<'a>, KeyFileError> {
+        if data.len() < HEADER_SIZE {
+            return Err(if data.len() < 8 || data[..8] != MAGIC { KeyFileError::BadMagic } else { KeyFileError::WrongLength });
+        }
+        let header = &data[..HEADER_SIZE];
+        if header[..8] != MAGIC {
+            return Err(KeyFileError::BadMagic);
+        }
+        if sha256(&header[..120])[..] != header[120..152] {
+            return Err(KeyFileError::CorruptHeader);
+        }
+        let version = get_u32(&header[8..]);
+        if version != VERSION {
+            return Err(KeyFileError::UnsupportedVersion(version));
+        }
+        if header[24..88] != generator_repr(secp)[..] {
+            return Err(KeyFileError::IncompatibleBuild);
+        }
+        let n = get_u64(&header[16..]);
+        let payload = &data[HEADER_SIZE..];
+        if n > (payload.len() / KEY_SIZE) as u64 || payload.len() != n as usize * KEY_SIZE {
+            return Err(KeyFileError::WrongLength);
+        }
+
+        let n = n as usize;
+        Ok(KeySet {
+            keys: unsafe { slice::from_raw_parts(payload.as_ptr() as *const PublicKey, n) },
+            payload: payload,
+            checksum: &header[88..120],
+            checked: (0..(n + BITS - 1) / BITS).map(|_| AtomicUsize::new(0)).collect()
+        })
+    }
+
+    /// Compares the keys with the checksum in the header, hashing all of them
+    pub fn verify_checksum(&self) -> Result<(), KeyFileError> {
+        if sha256(self.payload)[..] != self.checksum[..] {
+            return Err(KeyFileError::CorruptKeys);
+        }
+        Ok(())
+    }
+
+    /// The number of keys
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.keys.len()
+    }
+
+    /// Whether the file holds no keys
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.keys.is_empty()
+    }
+
+    /// All keys, checking those not checked yet first. Fails like
+    /// `check_all` if any key is invalid.
+    pub fn keys(&self, secp: &Secp256k1) -> Result<&'a [PublicKey], KeyFileError> {
+        try!(self.check_all(secp));
+        Ok(self.keys)
+    }
+
+    /// All keys, as they are stored, without checking them.
+    ///
+    /// Unsafe because the keys come straight from the file: the caller must
+    /// make sure they are valid points before using them, for example by a
+    /// successful `check_all`. An invalid key passed to ECDH can leak bits of
+    /// the secret key.
+    #[inline]
+    pub unsafe fn keys_unchecked(&self) -> &'a [PublicKey] {
+        self.keys
+    }
+
+    fn is_checked(&self, i: usize) -> bool {
+        self.checked[i / BITS].load(Ordering::Acquire) & (1 << (i % BITS)) != 0
+    }
+
+    fn check(&self, secp: &Secp256k1, start: usize, n: usize) -> Result<(), usize> {
+        let keys = &self.keys[start..start + n];
+        let bad = unsafe {
+            // `PublicKey` is a `repr(C)` wrapper, so the slice is an array
+            // of `ffi::PublicKey`
+            ffi::secp256k1_ext_pubkey_find_invalid(secp.ctx, keys.as_ptr() as *const ffi::PublicKey, n)
+        };
+        for i in start..start + bad {
+            self.checked[i / BITS].fetch_or(1 << (i % BITS), Ordering::Release);
+        }
+        if bad == n { Ok(()) } else { Err(start + bad) }
+    }
+
+    /// The key at index `i`, checked to be a valid point on first use. Fails
+    /// with `InvalidPublicKey` if it is not.
+    ///
+    /// Panics if `i` is out of bounds.
+    pub fn get(&self, secp: &Secp256k1, i: usize) -> Result<&'a PublicKey, Error> {
+        if !self.is_checked(i) {
+            try!(self.check(secp, i, 1).map_err(|_| InvalidPublicKey));
+        }
+        Ok(&self.keys[i])
+    }
+
+    /// Checks every key not checked yet. Fails with the index of the first
+    /// invalid key.
+    pub fn check_all(&self, secp: &Secp256k1) -> Result<(), KeyFileError> {
+        for (word, bits) in self.checked.iter().enumerate() {
+            let start = word * BITS;
+            let n = ::std::cmp::min(BITS, self.keys.len() - start);
+            if bits.load(Ordering::Acquire).count_ones() as usize == n {
+                continue;
+            }
+            try!(self.check(secp, start, n).map_err(KeyFileError::InvalidKey));
+        }
+        Ok(())
+    }
+}
+
+impl<'a> fmt::Debug for KeySet<'a> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "KeySet {{ len: {} }}", self.keys.len())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use rand::thread_rng;
+
+    use super::super::Secp256k1;
+    use super::super::Error::InvalidPublicKey;
+    use super::{write, KeySet, KeyFileError, HEADER_SIZE};
+
+    fn sample(s: &Secp256k1, n: usize) -> (Vec<::key::PublicKey>, Vec<u8>) {
+        let keys: Vec<_> = (0..n).map(|_| s.generate_keypair(&mut thread_rng()).unwrap().1).collect();
+        let mut data = Vec::new();
+        write(s, &mut data, &keys).unwrap();
+        (keys, data)
+    }
+
+    #[test]
+    fn keyfile_roundtrip() {
+        let s = Secp256k1::new();
+        let (keys, data) = sample(&s, 200);
+        assert_eq!(data.len(), HEADER_SIZE + 64 * keys.len());
+
+        let set = KeySet::from_bytes(&s, &data).unwrap();
+        assert_eq!(set.len(), keys.len());
+        assert_eq!(unsafe { set.keys_unchecked() }, &keys[..]);
+        assert_eq!(set.keys(&s).unwrap(), &keys[..]);
+        assert!(set.verify_checksum().is_ok());
+        assert_eq!(set.get(&s, 7), Ok(&keys[7]));
+        assert!(set.check_all(&s).is_ok());
+        for (i, pk) in keys.iter().enumerate() {
+            assert_eq!(set.get(&s, i), Ok(pk));
+        }
+
+        let (_, empty) = sample(&s, 0);
+        let set = KeySet::from_bytes(&s, &empty).unwrap();
+        assert!(set.is_empty());
+        assert!(set.check_all(&s).is_ok());
+
+        let mut out = Vec::new();
+        match write(&s, &mut out, &[keys[0], ::key::PublicKey::new()]) {
+            Err(KeyFileError::InvalidKey(1)) => {}
+            other => panic!("unexpected {:?}", other)
+        }
+        assert!(out.is_empty());
+    }
+
+    #[test]
+    fn keyfile_corruption() {
+        let s = Secp256k1::new();
+        let (_, data) = sample(&s, 70);
+
+        let mut bad = data.clone();
+        bad[0] ^= 1;
+        match KeySet::from_bytes(&s, &bad) { Err(KeyFileError::BadMagic) => {}, other => panic!("{:?}", other) }
+        let mut bad = data.clone();
+        bad[16] ^= 1;
+        match KeySet::from_bytes(&s, &bad) { Err(KeyFileError::CorruptHeader) => {}, other => panic!("{:?}", other) }
+        match KeySet::from_bytes(&s, &data[..data.len() - 1]) {
+            Err(KeyFileError::WrongLength) => {},
+            other => panic!("{:?}", other)
+        }
+
+        // A corrupted key is caught by the checksum, and by `get` and
+        // `check_all` even without it
+        let mut bad = data.clone();
+        bad[HEADER_SIZE + 64 * 65 + 3] ^= 1;
+        let set = KeySet::from_bytes(&s, &bad).unwrap();
+        match set.verify_checksum() { Err(KeyFileError::CorruptKeys) => {}, other => panic!("{:?}", other) }
+        assert!(set.get(&s, 64).is_ok());
+        assert_eq!(set.get(&s, 65), Err(InvalidPublicKey));
+        match set.check_all(&s) { Err(KeyFileError::InvalidKey(65)) => {}, other => panic!("{:?}", other) }
+
+        // So is a key with only its x coordinate zeroed
+        let mut bad = data.clone();
+        for b in &mut bad[HEADER_SIZE + 64 * 12..HEADER_SIZE + 64 * 12 + 32] {
+            *b = 0;
+        }
+        let set = KeySet::from_bytes(&s, &bad).unwrap();
+        assert_eq!(set.get(&s, 12), Err(InvalidPublicKey));
+        match set.check_all(&s) { Err(KeyFileError::InvalidKey(12)) => {}, other => panic!("{:?}", other) }
+        match set.keys(&s) { Err(KeyFileError::InvalidKey(12)) => {}, other => panic!("{:?}", other) }
+    }
+}
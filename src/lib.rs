@@ -48,15 +48,28 @@ extern crate rand_core;
 #[macro_use]
 extern crate hex_literal;
 
-use std::{error, fmt, ops, ptr};
+use std::{error, fmt, ops, ptr, slice};
+use std::sync::{Arc, Once};
+use std::os::raw::c_int;
 use rand::Rng;
 
 #[macro_use]
 mod macros;
+pub mod batch;
+pub mod cache;
 pub mod constants;
 pub mod ecdh;
 pub mod ffi;
 pub mod key;
+pub mod keyfile;
+#[cfg(feature = "metrics")]
+pub mod metrics;
+#[cfg(feature = "parallel")]
+pub mod parallel;
+pub mod pool;
+#[cfg(feature = "service")]
+pub mod service;
+pub mod session;
 
 /// A tag used for recovering the public key from a compact signature
 #[derive(Copy, Clone, PartialEq, Eq, Debug)]
@@ -91,6 +104,7 @@ impl Signature {
     #[inline]
     /// Converts a DER-encoded byte slice to a signature
     pub fn from_der(secp: &Secp256k1, data: &[u8]) -> Result<Signature, Error> {
+        metrics_timer!(secp, Parse);
         let mut ret = unsafe { ffi::Signature::blank() };
 
         unsafe {
@@ -108,6 +122,7 @@ impl Signature {
     /// 2016. It should never be used in new applications. This library does not
     /// support serializing to this "format"
     pub fn from_der_lax(secp: &Secp256k1, data: &[u8]) -> Result<Signature, Error> {
+        metrics_timer!(secp, Parse);
         unsafe {
             let mut ret = ffi::Signature::blank();
             if ffi::ecdsa_signature_parse_der_lax(secp.ctx, &mut ret,
@@ -119,6 +134,51 @@ impl Signature {
         }
     }
 
+    /// Parses the DER signatures packed in `input`, where signature `i` spans
+    /// bytes `offsets[i]..offsets[i + 1]`, into `output[i]`. Equivalent to
+    /// `from_der` on each, with one FFI call per `ffi::SECP256K1_EXT_BATCH_MAX`
+    /// signatures.
+    ///
+    /// Panics unless `offsets.len() == output.len() + 1` and the offsets are
+    /// nondecreasing and within `input`.
+    pub fn from_der_batch(secp: &Secp256k1, input: &[u8], offsets: &[usize],
+                          output: &mut [Result<Signature, Error>]) {
+        Signature::parse_der_batch(secp, input, offsets, output, false)
+    }
+
+    /// Like `from_der_batch`, but equivalent to `from_der_lax` on each
+    /// signature
+    pub fn from_der_lax_batch(secp: &Secp256k1, input: &[u8], offsets: &[usize],
+                              output: &mut [Result<Signature, Error>]) {
+        Signature::parse_der_batch(secp, input, offsets, output, true)
+    }
+
+    fn parse_der_batch(secp: &Secp256k1, input: &[u8], offsets: &[usize],
+                       output: &mut [Result<Signature, Error>], lax: bool) {
+        metrics_timer!(secp, Parse, output.len());
+        metrics_span!("from_der_batch", output.len());
+        assert_eq!(offsets.len(), output.len() + 1, "from_der_batch: offsets must have one more entry than output");
+        assert!(offsets.windows(2).all(|w| w[0] <= w[1]) && offsets[offsets.len() - 1] <= input.len(),
+                "from_der_batch: offsets out of order or out of bounds");
+
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        let mut sigs = [ffi::Signature::new(); BATCH];
+        let mut results = [0; BATCH];
+
+        for (k, output) in output.chunks_mut(BATCH).enumerate() {
+            unsafe {
+                let err = ffi::secp256k1_ext_ecdsa_signature_parse_der_batch(secp.ctx, sigs.as_mut_ptr(),
+                                                                             results.as_mut_ptr(), input.as_ptr(),
+                                                                             offsets[k * BATCH..].as_ptr(),
+                                                                             output.len(), lax as c_int);
+                debug_assert_eq!(err, 1);
+            }
+            for (i, out) in output.iter_mut().enumerate() {
+                *out = if results[i] == 1 { Ok(Signature(sigs[i])) } else { Err(Error::InvalidSignature) };
+            }
+        }
+    }
+
     /// Normalizes a signature to a "low S" form. In ECDSA, signatures are
     /// of the form (r, s) where r and s are numbers lying in some finite
     /// field. The verification equation will pass for (r, s) iff it passes
@@ -160,6 +220,7 @@ impl Signature {
     #[inline]
     /// Serializes the signature in DER format
     pub fn serialize_der(&self, secp: &Secp256k1) -> Vec<u8> {
+        metrics_timer!(secp, Serialize);
         let mut ret = Vec::with_capacity(72);
         let mut len: usize = ret.capacity() as usize;
         unsafe {
@@ -187,6 +248,7 @@ impl RecoverableSignature {
     /// representation is nonstandard and defined by the libsecp256k1
     /// library.
     pub fn from_compact(secp: &Secp256k1, data: &[u8], recid: RecoveryId) -> Result<RecoverableSignature, Error> {
+        metrics_timer!(secp, Parse);
         let mut ret = unsafe { ffi::RecoverableSignature::blank() };
 
         unsafe {
@@ -201,6 +263,54 @@ impl RecoverableSignature {
         }
     }
 
+    /// Parses 65-byte r || s || v signatures packed in `input`, signature `i`
+    /// starting at byte `offsets[i]`, into `output[i]`. v is the recovery ID
+    /// (0 to 3, without any offset such as Ethereum's 27), and a signature is
+    /// accepted exactly when `CompactSigRef::from_rsv` and `from_compact`
+    /// would accept it. The checks run without branching on the input, with
+    /// one FFI call per `ffi::SECP256K1_EXT_BATCH_MAX` signatures.
+    ///
+    /// Panics unless `offsets.len() == output.len()` and every signature lies
+    /// within `input`.
+    pub fn from_rsv_batch(secp: &Secp256k1, input: &[u8], offsets: &[usize],
+                          output: &mut [Result<RecoverableSignature, Error>]) {
+        RecoverableSignature::parse_rsv_batch(secp, input, offsets, output, false)
+    }
+
+    /// Like `from_rsv_batch`, but accepts only canonical Ethereum signatures:
+    /// r and s must also be nonzero, s must be in the lower half of its range
+    /// and v must be 0 or 1
+    pub fn from_rsv_batch_strict(secp: &Secp256k1, input: &[u8], offsets: &[usize],
+                                 output: &mut [Result<RecoverableSignature, Error>]) {
+        RecoverableSignature::parse_rsv_batch(secp, input, offsets, output, true)
+    }
+
+    fn parse_rsv_batch(secp: &Secp256k1, input: &[u8], offsets: &[usize],
+                       output: &mut [Result<RecoverableSignature, Error>], strict: bool) {
+        metrics_timer!(secp, Parse, output.len());
+        metrics_span!("from_rsv_batch", output.len());
+        const SIZE: usize = constants::COMPACT_SIGNATURE_SIZE + 1;
+        assert_eq!(offsets.len(), output.len(), "from_rsv_batch: offsets and output lengths differ");
+        assert!(offsets.iter().all(|&offset| offset <= input.len() && input.len() - offset >= SIZE),
+                "from_rsv_batch: offset out of bounds");
+
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        let mut sigs = [ffi::RecoverableSignature::new(); BATCH];
+        let mut results = [0; BATCH];
+
+        for (offsets, output) in offsets.chunks(BATCH).zip(output.chunks_mut(BATCH)) {
+            unsafe {
+                let err = ffi::secp256k1_ext_ecdsa_recoverable_signature_parse_rsv_batch(
+                    secp.ctx, sigs.as_mut_ptr(), results.as_mut_ptr(), input.as_ptr(),
+                    offsets.as_ptr(), offsets.len(), strict as c_int);
+                debug_assert_eq!(err, 1);
+            }
+            for (i, out) in output.iter_mut().enumerate() {
+                *out = if results[i] == 1 { Ok(RecoverableSignature(sigs[i])) } else { Err(Error::InvalidSignature) };
+            }
+        }
+    }
+
     /// Obtains a raw pointer suitable for use with FFI functions
     #[inline]
     pub fn as_ptr(&self) -> *const ffi::RecoverableSignature {
@@ -210,6 +320,7 @@ impl RecoverableSignature {
     #[inline]
     /// Serializes the recoverable signature in compact format
     pub fn serialize_compact(&self, secp: &Secp256k1) -> (RecoveryId, [u8; 64]) {
+        metrics_timer!(secp, Serialize);
         let mut ret = [0u8; 64];
         let mut recid = 0i32;
         unsafe {
@@ -241,6 +352,51 @@ impl From<ffi::RecoverableSignature> for RecoverableSignature {
     }
 }
 
+/// A borrowed, unparsed 64-byte compact (r || s) signature with a recovery
+/// ID, e.g. pointing into a network buffer. Only the length is checked on
+/// construction; the signature is parsed inside the FFI call which uses it
+/// (`recover_ref`, `recover_address_ref` or `verify_ref`), without first being
+/// copied into a `RecoverableSignature`.
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub struct CompactSigRef<'a> {
+    data: &'a [u8],
+    recid: RecoveryId
+}
+
+impl<'a> CompactSigRef<'a> {
+    /// Borrows a 64-byte compact signature
+    #[inline]
+    pub fn new(data: &'a [u8], recid: RecoveryId) -> Result<CompactSigRef<'a>, Error> {
+        if data.len() != constants::COMPACT_SIGNATURE_SIZE {
+            return Err(Error::InvalidSignature);
+        }
+        Ok(CompactSigRef { data: data, recid: recid })
+    }
+
+    /// Borrows a 65-byte r || s || v signature, where v is the recovery ID
+    /// (0 to 3, without any offset such as Ethereum's 27)
+    #[inline]
+    pub fn from_rsv(data: &'a [u8]) -> Result<CompactSigRef<'a>, Error> {
+        if data.len() != constants::COMPACT_SIGNATURE_SIZE + 1 {
+            return Err(Error::InvalidSignature);
+        }
+        let recid = try!(RecoveryId::from_i32(data[64] as i32));
+        Ok(CompactSigRef { data: &data[..64], recid: recid })
+    }
+
+    /// The recovery ID
+    #[inline]
+    pub fn recovery_id(&self) -> RecoveryId {
+        self.recid
+    }
+
+    /// Obtains a raw pointer to the 64 signature bytes
+    #[inline]
+    pub fn as_ptr(&self) -> *const u8 {
+        self.data.as_ptr()
+    }
+}
+
 impl ops::Index<usize> for Signature {
     type Output = u8;
 
@@ -351,12 +507,33 @@ impl error::Error for Error {
 /// The secp256k1 engine, used to execute all signature operations
 pub struct Secp256k1 {
     ctx: *mut ffi::Context,
-    caps: ContextFlag
+    caps: ContextFlag,
+    // The context whose allocation holds the precomputed tables used by `ctx`,
+    // or `None` if `ctx` uses the build-time tables. Clones share the tables
+    // and only get their own copy of the (small) context struct.
+    tables: Option<Arc<Tables>>,
+    recover_cache: Option<Arc<cache::RecoverCache>>,
+    sig_cache: Option<Arc<cache::SigCache>>,
+    #[cfg(feature = "metrics")]
+    metrics: Arc<metrics::Metrics>
 }
 
 unsafe impl Send for Secp256k1 {}
 unsafe impl Sync for Secp256k1 {}
 
+// Owner of a context created by `secp256k1_context_create`, which is kept
+// alive (and unused) for as long as some `Secp256k1` uses its tables
+struct Tables(*mut ffi::Context);
+
+unsafe impl Send for Tables {}
+unsafe impl Sync for Tables {}
+
+impl Drop for Tables {
+    fn drop(&mut self) {
+        unsafe { ffi::secp256k1_context_destroy(self.0); }
+    }
+}
+
 /// Flags used to determine the capabilities of a `Secp256k1` object;
 /// the more capabilities, the more expensive it is to create.
 #[derive(PartialEq, Eq, Copy, Clone, Debug)]
@@ -379,11 +556,59 @@ impl fmt::Display for ContextFlag {
     }
 }
 
+/// The memory used by a context, as reported by `Secp256k1::memory_footprint`.
+/// Table sizes are fixed at build time (see "Precomputed tables" in the
+/// README); which tables a context has depends on its `ContextFlag`.
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub struct MemoryFootprint {
+    /// Bytes of the context struct, including its blinding state, which
+    /// every context and every clone owns
+    pub context: usize,
+    /// Bytes of the signing table, 0 if the context has none
+    pub gen_table: usize,
+    /// Bytes of the verification tables, 0 if the context has none
+    pub ecmult_table: usize,
+    /// Whether the signing table is compiled-in read-only data shared by the
+    /// whole process, rather than heap owned by the context and its clones
+    pub gen_table_static: bool,
+    /// Whether the verification tables are compiled-in read-only data shared
+    /// by the whole process, rather than heap owned by the context and its
+    /// clones
+    pub ecmult_table_static: bool
+}
+
+impl MemoryFootprint {
+    /// Bytes of heap allocated for the context and its tables. The tables
+    /// are shared with the context's clones, which only add `context` bytes
+    /// each.
+    pub fn heap(&self) -> usize {
+        let gen = if self.gen_table_static { 0 } else { self.gen_table };
+        let ecmult = if self.ecmult_table_static { 0 } else { self.ecmult_table };
+        self.context + gen + ecmult
+    }
+
+    /// Bytes of memory referenced by the context, static or not
+    pub fn total(&self) -> usize {
+        self.context + self.gen_table + self.ecmult_table
+    }
+}
+
+/// Clones share the precomputed tables, the result caches, if any, and the
+/// metrics. Only the context struct, including its blinding state, is
+/// copied, so a clone costs one small allocation and can be `randomize`d
+/// independently of the original.
 impl Clone for Secp256k1 {
     fn clone(&self) -> Secp256k1 {
+        metrics_timer!(self, ContextClone);
+        let ctx = unsafe { ffi::secp256k1_context_clone_shallow(self.ctx) };
         Secp256k1 {
-            ctx: unsafe { ffi::secp256k1_context_clone(self.ctx) },
-            caps: self.caps
+            ctx: ctx,
+            caps: self.caps,
+            tables: self.tables.clone(),
+            recover_cache: self.recover_cache.clone(),
+            sig_cache: self.sig_cache.clone(),
+            #[cfg(feature = "metrics")]
+            metrics: self.metrics.clone()
         }
     }
 }
@@ -401,7 +626,11 @@ impl fmt::Debug for Secp256k1 {
 
 impl Drop for Secp256k1 {
     fn drop(&mut self) {
-        unsafe { ffi::secp256k1_context_destroy(self.ctx); }
+        // The context owning the tables is freed by the last `Tables` handle
+        let owner = self.tables.as_ref().map_or(false, |tables| tables.0 == self.ctx);
+        if !owner {
+            unsafe { ffi::secp256k1_context_destroy_shallow(self.ctx); }
+        }
     }
 }
 
@@ -420,7 +649,116 @@ impl Secp256k1 {
             ContextFlag::VerifyOnly => ffi::SECP256K1_START_VERIFY,
             ContextFlag::Full => ffi::SECP256K1_START_SIGN | ffi::SECP256K1_START_VERIFY
         };
-        Secp256k1 { ctx: unsafe { ffi::secp256k1_context_create(flag) }, caps: caps }
+        #[cfg(feature = "metrics")]
+        let metrics = Arc::new(metrics::Metrics::new());
+        #[cfg(feature = "metrics")]
+        let timer = metrics::Timer::new(&metrics, metrics::Op::ContextCreate, 1);
+        let ctx = unsafe { ffi::secp256k1_context_create(flag) };
+        #[cfg(feature = "metrics")]
+        drop(timer);
+        Secp256k1 { ctx: ctx, caps: caps, tables: Some(Arc::new(Tables(ctx))),
+                    recover_cache: None, sig_cache: None,
+                    #[cfg(feature = "metrics")]
+                    metrics: metrics }
+    }
+
+    /// Creates a context with the specified capabilities on top of the tables
+    /// compiled into the library, which are shared by the whole process, so
+    /// only the context struct is allocated. `with_caps` instead allocates the
+    /// verification tables on the heap for a verify-capable context, so this
+    /// is the leaner choice for a `VerifyOnly` context. The unused tables of
+    /// the role stay untouched read-only data. Falls back to `with_caps` if
+    /// the library was built without static tables.
+    pub fn with_caps_static(caps: ContextFlag) -> Secp256k1 {
+        let ctx = unsafe { ffi::secp256k1_context_create_static() };
+        if ctx.is_null() {
+            return Secp256k1::with_caps(caps);
+        }
+        Secp256k1 { ctx: ctx, caps: caps, tables: None,
+                    recover_cache: None, sig_cache: None,
+                    #[cfg(feature = "metrics")]
+                    metrics: Arc::new(metrics::Metrics::new()) }
+    }
+
+    /// Returns a process-wide context with full capabilities. Its precomputed
+    /// tables are generated at build time and compiled in as read-only data,
+    /// so no tables are built or allocated at startup, and they are shared
+    /// with every clone of this context. Clone it to get a context which can
+    /// be `randomize`d independently.
+    pub fn global() -> &'static Secp256k1 {
+        static INIT: Once = Once::new();
+        static mut GLOBAL: *const Secp256k1 = 0 as *const Secp256k1;
+
+        unsafe {
+            INIT.call_once(|| {
+                let ctx = ffi::secp256k1_context_create_static();
+                let secp = if ctx.is_null() {
+                    // Built without static tables
+                    Secp256k1::new()
+                } else {
+                    Secp256k1 { ctx: ctx, caps: ContextFlag::Full, tables: None,
+                                recover_cache: None, sig_cache: None,
+                                #[cfg(feature = "metrics")]
+                                metrics: Arc::new(metrics::Metrics::new()) }
+                };
+                // Never freed, like any other static
+                GLOBAL = Box::into_raw(Box::new(secp));
+            });
+            &*GLOBAL
+        }
+    }
+
+    /// Makes `recover` and `recover_batch` (and `par_recover`) consult `cache`
+    /// before recovering a key and store what they recover in it; `None`
+    /// detaches the current cache. Clones made afterwards share the cache.
+    pub fn set_recover_cache(&mut self, cache: Option<Arc<cache::RecoverCache>>) {
+        self.recover_cache = cache;
+    }
+
+    /// The recovery cache attached with `set_recover_cache`, if any
+    pub fn recover_cache(&self) -> Option<&Arc<cache::RecoverCache>> {
+        self.recover_cache.as_ref()
+    }
+
+    /// Makes `verify` (and `par_verify`) accept triples found in `cache`
+    /// without verifying them, and add the triples it verifies successfully;
+    /// `None` detaches the current cache. Clones made afterwards share the
+    /// cache.
+    pub fn set_sig_cache(&mut self, cache: Option<Arc<cache::SigCache>>) {
+        self.sig_cache = cache;
+    }
+
+    /// The signature cache attached with `set_sig_cache`, if any
+    pub fn sig_cache(&self) -> Option<&Arc<cache::SigCache>> {
+        self.sig_cache.as_ref()
+    }
+
+    /// The operation counters of this context and its clones. Requires the
+    /// `metrics` feature.
+    #[cfg(feature = "metrics")]
+    pub fn metrics(&self) -> &metrics::Metrics {
+        &self.metrics
+    }
+
+    /// Reports the memory used by this context and its tables. A context
+    /// created with `with_caps_static` (or `global`) has static tables, and
+    /// only its tables for `caps` count towards `total`.
+    pub fn memory_footprint(&self) -> MemoryFootprint {
+        let (mut context, mut gen, mut ecmult) = (0, 0, 0);
+        let (mut gen_static, mut ecmult_static) = (0, 0);
+        unsafe {
+            ffi::secp256k1_ext_context_footprint(self.ctx, &mut context, &mut gen, &mut ecmult,
+                                                  &mut gen_static, &mut ecmult_static);
+        }
+        let signs = self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::Full;
+        let verifies = self.caps == ContextFlag::VerifyOnly || self.caps == ContextFlag::Full;
+        MemoryFootprint {
+            context: context,
+            gen_table: if signs || gen_static == 0 { gen } else { 0 },
+            ecmult_table: if verifies || ecmult_static == 0 { ecmult } else { 0 },
+            gen_table_static: gen_static == 1,
+            ecmult_table_static: ecmult_static == 1
+        }
     }
 
     /// Creates a new Secp256k1 context with no capabilities (just de/serialization)
@@ -448,8 +786,9 @@ impl Secp256k1 {
     }
 
     /// Generates a random keypair. Convenience function for `key::SecretKey::new`
-    /// and `key::PublicKey::from_secret_key`; call those functions directly for
-    /// batch key generation. Requires a signing-capable context.
+    /// and `key::PublicKey::from_secret_key`; for batch key generation, create
+    /// the secret keys with `key::SecretKey::new` and their public keys with
+    /// `key::PublicKey::from_secret_keys`. Requires a signing-capable context.
     #[inline]
     pub fn generate_keypair<R: Rng>(&self, rng: &mut R)
                                    -> Result<(key::SecretKey, key::PublicKey), Error> {
@@ -459,9 +798,11 @@ impl Secp256k1 {
     }
 
     /// Constructs a signature for `msg` using the secret key `sk` and RFC6979 nonce
-    /// Requires a signing-capable context.
+    /// Requires a signing-capable context. To sign many messages with one key,
+    /// see `session::SigningSession`.
     pub fn sign(&self, msg: &Message, sk: &key::SecretKey)
                 -> Result<Signature, Error> {
+        metrics_timer!(self, Sign);
         if self.caps == ContextFlag::VerifyOnly || self.caps == ContextFlag::None {
             return Err(Error::IncapableContext);
         }
@@ -481,6 +822,7 @@ impl Secp256k1 {
     /// Requires a signing-capable context.
     pub fn sign_recoverable(&self, msg: &Message, sk: &key::SecretKey)
                 -> Result<RecoverableSignature, Error> {
+        metrics_timer!(self, Sign);
         if self.caps == ContextFlag::VerifyOnly || self.caps == ContextFlag::None {
             return Err(Error::IncapableContext);
         }
@@ -497,13 +839,30 @@ impl Secp256k1 {
     }
 
     /// Determines the public key for which `sig` is a valid signature for
-    /// `msg`. Requires a verify-capable context.
+    /// `msg`. Requires a verify-capable context. With a recovery cache
+    /// attached, a cached result is returned without recovering the key.
     pub fn recover(&self, msg: &Message, sig: &RecoverableSignature)
                   -> Result<key::PublicKey, Error> {
+        metrics_timer!(self, Recover);
         if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
             return Err(Error::IncapableContext);
         }
 
+        match self.recover_cache {
+            Some(ref cache) => {
+                if let Some(res) = cache.get(msg, sig) {
+                    return res;
+                }
+                let res = self.recover_uncached(msg, sig);
+                cache.insert(msg, sig, res);
+                res
+            }
+            None => self.recover_uncached(msg, sig)
+        }
+    }
+
+    fn recover_uncached(&self, msg: &Message, sig: &RecoverableSignature)
+                        -> Result<key::PublicKey, Error> {
         let mut pk = unsafe { ffi::PublicKey::blank() };
 
         unsafe {
@@ -515,24 +874,304 @@ impl Secp256k1 {
         Ok(key::PublicKey::from(pk))
     }
 
+    /// Like `recover`, but parses the borrowed signature in the same FFI call
+    pub fn recover_ref(&self, msg: &Message, sig: &CompactSigRef)
+                       -> Result<key::PublicKey, Error> {
+        metrics_timer!(self, Recover);
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+
+        let mut pk = unsafe { ffi::PublicKey::blank() };
+        unsafe {
+            if ffi::secp256k1_ext_ecdsa_recover_compact(self.ctx, &mut pk, sig.as_ptr(),
+                                                        sig.recid.0, msg.as_ptr()) != 1 {
+                return Err(Error::InvalidSignature);
+            }
+        }
+        Ok(key::PublicKey::from(pk))
+    }
+
+    /// Determines the public keys for a batch of (message, signature) pairs,
+    /// writing the outcome for `input[i]` to `output[i]`. This is equivalent
+    /// to calling `recover` on every pair, but crosses the FFI boundary once per
+    /// `ffi::SECP256K1_EXT_BATCH_MAX` items and shares the field inversions
+    /// across them. Requires a verify-capable context. With a recovery cache
+    /// attached, only the pairs missing from it are recovered.
+    ///
+    /// Panics if `input` and `output` differ in length.
+    pub fn recover_batch(&self, input: &[(Message, RecoverableSignature)],
+                         output: &mut [Result<key::PublicKey, Error>])
+                         -> Result<(), Error> {
+        metrics_timer!(self, Recover, input.len());
+        metrics_span!("recover_batch", input.len());
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+        assert_eq!(input.len(), output.len(), "recover_batch: input and output lengths differ");
+
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        let mut pks = [ffi::PublicKey::new(); BATCH];
+        let mut results = [0; BATCH];
+        let mut sigs: [*const ffi::RecoverableSignature; BATCH] = [ptr::null(); BATCH];
+        let mut msgs: [*const u8; BATCH] = [ptr::null(); BATCH];
+
+        // Positions in the chunk of the pairs passed to the FFI call
+        let mut misses = [0; BATCH];
+        let cache = self.recover_cache.as_ref();
+
+        for (input, output) in input.chunks(BATCH).zip(output.chunks_mut(BATCH)) {
+            let mut n = 0;
+            for (i, &(ref msg, ref sig)) in input.iter().enumerate() {
+                if let Some(res) = cache.and_then(|cache| cache.get(msg, sig)) {
+                    output[i] = res;
+                    continue;
+                }
+                msgs[n] = msg.as_ptr();
+                sigs[n] = sig.as_ptr();
+                misses[n] = i;
+                n += 1;
+            }
+            if n == 0 {
+                continue;
+            }
+            unsafe {
+                let err = ffi::secp256k1_ecdsa_recover_batch(self.ctx, pks.as_mut_ptr(),
+                                                             results.as_mut_ptr(), sigs.as_ptr(),
+                                                             msgs.as_ptr(), n);
+                debug_assert_eq!(err, 1);
+            }
+            for (j, &i) in misses[..n].iter().enumerate() {
+                output[i] = if results[j] == 1 {
+                    Ok(key::PublicKey::from(pks[j]))
+                } else {
+                    Err(Error::InvalidSignature)
+                };
+                if let Some(cache) = cache {
+                    cache.insert(&input[i].0, &input[i].1, output[i]);
+                }
+            }
+        }
+        Ok(())
+    }
+
+    /// Determines the Ethereum address (the last 20 bytes of the Keccak-256
+    /// hash of the uncompressed public key without its prefix byte) of the
+    /// signer of `msg`. Equivalent to hashing the output of `recover`, but the
+    /// key is serialized and hashed on the C side without coming back through
+    /// Rust. Requires a verify-capable context.
+    pub fn recover_address(&self, msg: &Message, sig: &RecoverableSignature)
+                           -> Result<[u8; constants::ADDRESS_SIZE], Error> {
+        metrics_timer!(self, Recover);
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+
+        let mut address = [0; constants::ADDRESS_SIZE];
+        unsafe {
+            if ffi::secp256k1_ext_ecdsa_recover_address(self.ctx, address.as_mut_ptr(),
+                                                        sig.as_ptr(), msg.as_ptr()) != 1 {
+                return Err(Error::InvalidSignature);
+            }
+        }
+        Ok(address)
+    }
+
+    /// Like `recover_address`, but parses the borrowed signature in the same
+    /// FFI call
+    pub fn recover_address_ref(&self, msg: &Message, sig: &CompactSigRef)
+                               -> Result<[u8; constants::ADDRESS_SIZE], Error> {
+        metrics_timer!(self, Recover);
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+
+        let mut address = [0; constants::ADDRESS_SIZE];
+        unsafe {
+            if ffi::secp256k1_ext_ecdsa_recover_address_compact(self.ctx, address.as_mut_ptr(), sig.as_ptr(),
+                                                                sig.recid.0, msg.as_ptr()) != 1 {
+                return Err(Error::InvalidSignature);
+            }
+        }
+        Ok(address)
+    }
+
+    /// Batch version of `recover_address`, shared like `recover_batch`.
+    /// `output[i]` receives the address for `input[i]`. Requires a
+    /// verify-capable context.
+    ///
+    /// Panics if `input` and `output` differ in length.
+    pub fn recover_address_batch(&self, input: &[(Message, RecoverableSignature)],
+                                 output: &mut [Result<[u8; constants::ADDRESS_SIZE], Error>])
+                                 -> Result<(), Error> {
+        metrics_timer!(self, Recover, input.len());
+        metrics_span!("recover_address_batch", input.len());
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+        assert_eq!(input.len(), output.len(), "recover_address_batch: input and output lengths differ");
+
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        let mut addresses = [[0u8; constants::ADDRESS_SIZE]; BATCH];
+        let mut results = [0; BATCH];
+        let mut sigs: [*const ffi::RecoverableSignature; BATCH] = [ptr::null(); BATCH];
+        let mut msgs: [*const u8; BATCH] = [ptr::null(); BATCH];
+
+        for (input, output) in input.chunks(BATCH).zip(output.chunks_mut(BATCH)) {
+            for (i, &(ref msg, ref sig)) in input.iter().enumerate() {
+                msgs[i] = msg.as_ptr();
+                sigs[i] = sig.as_ptr();
+            }
+            unsafe {
+                let err = ffi::secp256k1_ext_ecdsa_recover_address_batch(self.ctx, addresses[0].as_mut_ptr(),
+                                                                         results.as_mut_ptr(), sigs.as_ptr(),
+                                                                         msgs.as_ptr(), input.len());
+                debug_assert_eq!(err, 1);
+            }
+            for (i, out) in output.iter_mut().enumerate() {
+                *out = if results[i] == 1 {
+                    Ok(addresses[i])
+                } else {
+                    Err(Error::InvalidSignature)
+                };
+            }
+        }
+        Ok(())
+    }
+
+    /// Checks a batch of (message, signature, public key) triples in one go,
+    /// where each signature is valid if it recovers to its public key (that is,
+    /// if `recover(msg, sig) == Ok(pk)`; unlike `verify` this accepts high-S
+    /// signatures and requires the right recovery ID). Returns `Ok(())` only if
+    /// every triple is valid. The recovery ID determines the nonce point of the
+    /// signature, so the whole batch reduces to a single randomized multi-scalar
+    /// multiplication per `ffi::SECP256K1_EXT_BATCH_MAX` triples instead of one
+    /// double multiplication per signature. Use `verify_batch_each` to find the
+    /// failing triples. Requires a verify-capable context.
+    pub fn verify_batch(&self, input: &[(Message, RecoverableSignature, key::PublicKey)])
+                        -> Result<(), Error> {
+        metrics_timer!(self, Verify, input.len());
+        metrics_span!("verify_batch", input.len());
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+
+        for chunk in input.chunks(ffi::SECP256K1_EXT_BATCH_MAX) {
+            if chunk.iter().any(|&(_, _, ref pk)| !pk.is_valid()) {
+                return Err(Error::InvalidPublicKey);
+            }
+            if !self.verify_recoverable_chunk(chunk) {
+                return Err(Error::IncorrectSignature);
+            }
+        }
+        Ok(())
+    }
+
+    /// Like `verify_batch`, but writes the result for `input[i]` to `output[i]`.
+    /// Valid chunks of the input still cost a single batch check, only chunks
+    /// which fail it are checked triple by triple. Requires a verify-capable
+    /// context.
+    ///
+    /// Panics if `input` and `output` differ in length.
+    pub fn verify_batch_each(&self, input: &[(Message, RecoverableSignature, key::PublicKey)],
+                             output: &mut [Result<(), Error>])
+                             -> Result<(), Error> {
+        metrics_timer!(self, Verify, input.len());
+        metrics_span!("verify_batch_each", input.len());
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+        assert_eq!(input.len(), output.len(), "verify_batch_each: input and output lengths differ");
+
+        for (input, output) in input.chunks(ffi::SECP256K1_EXT_BATCH_MAX)
+                                    .zip(output.chunks_mut(ffi::SECP256K1_EXT_BATCH_MAX)) {
+            if input.iter().all(|&(_, _, ref pk)| pk.is_valid()) && self.verify_recoverable_chunk(input) {
+                for out in output.iter_mut() {
+                    *out = Ok(());
+                }
+                continue;
+            }
+            for (item, out) in input.iter().zip(output.iter_mut()) {
+                *out = if !item.2.is_valid() {
+                    Err(Error::InvalidPublicKey)
+                } else if self.verify_recoverable_chunk(slice::from_ref(item)) {
+                    Ok(())
+                } else {
+                    Err(Error::IncorrectSignature)
+                };
+            }
+        }
+        Ok(())
+    }
+
+    // Runs the batch check on at most `ffi::SECP256K1_EXT_BATCH_MAX` triples
+    // with valid public keys
+    fn verify_recoverable_chunk(&self, chunk: &[(Message, RecoverableSignature, key::PublicKey)]) -> bool {
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        debug_assert!(chunk.len() <= BATCH);
+        let mut msgs: [*const u8; BATCH] = [ptr::null(); BATCH];
+        let mut sigs: [*const ffi::RecoverableSignature; BATCH] = [ptr::null(); BATCH];
+        let mut pks: [*const ffi::PublicKey; BATCH] = [ptr::null(); BATCH];
+
+        for (i, &(ref msg, ref sig, ref pk)) in chunk.iter().enumerate() {
+            msgs[i] = msg.as_ptr();
+            sigs[i] = sig.as_ptr();
+            pks[i] = pk.as_ptr();
+        }
+        unsafe {
+            ffi::secp256k1_ecdsa_verify_recoverable_batch(self.ctx, sigs.as_ptr(), msgs.as_ptr(),
+                                                          pks.as_ptr(), chunk.len()) == 1
+        }
+    }
+
     /// Checks that `sig` is a valid ECDSA signature for `msg` using the public
     /// key `pubkey`. Returns `Ok(true)` on success. Note that this function cannot
     /// be used for Bitcoin consensus checking since there may exist signatures
     /// which OpenSSL would verify but not libsecp256k1, or vice-versa. Requires a
-    /// verify-capable context.
+    /// verify-capable context. With a signature cache attached, a cached triple
+    /// is accepted without verifying it.
     #[inline]
     pub fn verify(&self, msg: &Message, sig: &Signature, pk: &key::PublicKey) -> Result<(), Error> {
+        metrics_timer!(self, Verify);
         if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
             return Err(Error::IncapableContext);
         }
 
         if !pk.is_valid() {
-            Err(Error::InvalidPublicKey)
-        } else if unsafe { ffi::secp256k1_ecdsa_verify(self.ctx, sig.as_ptr(), msg.as_ptr(),
-                                                       pk.as_ptr()) } == 0 {
-            Err(Error::IncorrectSignature)
-        } else {
-            Ok(())
+            return Err(Error::InvalidPublicKey);
+        }
+        if let Some(ref cache) = self.sig_cache {
+            if cache.contains(msg, sig, pk) {
+                return Ok(());
+            }
+        }
+        if unsafe { ffi::secp256k1_ecdsa_verify(self.ctx, sig.as_ptr(), msg.as_ptr(),
+                                                pk.as_ptr()) } == 0 {
+            return Err(Error::IncorrectSignature);
+        }
+        if let Some(ref cache) = self.sig_cache {
+            cache.insert(msg, sig, pk);
+        }
+        Ok(())
+    }
+
+    /// Like `verify`, but parses the borrowed signature and public key in the
+    /// same FFI call. The recovery ID of `sig` is ignored.
+    pub fn verify_ref(&self, msg: &Message, sig: &CompactSigRef, pk: &key::PubkeyRef) -> Result<(), Error> {
+        metrics_timer!(self, Verify);
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+
+        let res = unsafe {
+            ffi::secp256k1_ext_ecdsa_verify_compact(self.ctx, sig.as_ptr(), msg.as_ptr(),
+                                                    pk.as_ptr(), pk.as_slice().len())
+        };
+        match res {
+            1 => Ok(()),
+            0 => Err(Error::IncorrectSignature),
+            -1 => Err(Error::InvalidSignature),
+            _ => Err(Error::InvalidPublicKey)
         }
     }
 }
@@ -542,12 +1181,19 @@ impl Secp256k1 {
 mod tests {
     use rand::{RngCore, thread_rng};
 
-    use key::{SecretKey, PublicKey};
+    use key::{SecretKey, PublicKey, PubkeyRef, ONE_KEY};
     use super::constants;
-    use super::{Secp256k1, Signature, RecoverableSignature, Message, RecoveryId, ContextFlag};
+    use super::{Secp256k1, Signature, RecoverableSignature, CompactSigRef, Message, RecoveryId, ContextFlag};
     use super::Error::{InvalidMessage, InvalidPublicKey, IncorrectSignature, InvalidSignature,
                        IncapableContext};
 
+    /// A random message, for the tests of all modules
+    pub fn random_message() -> Message {
+        let mut msg = [0u8; 32];
+        thread_rng().fill_bytes(&mut msg);
+        Message::from_slice(&msg).unwrap()
+    }
+
     #[test]
     fn capabilities() {
         let none = Secp256k1::with_caps(ContextFlag::None);
@@ -604,6 +1250,95 @@ mod tests {
         assert_eq!(pk, new_pk);
     }
 
+    #[test]
+    fn shallow_clone() {
+        let mut msg = [0u8; 32];
+        thread_rng().fill_bytes(&mut msg);
+        let msg = Message::from_slice(&msg).unwrap();
+
+        for &caps in [ContextFlag::Full, ContextFlag::SignOnly, ContextFlag::VerifyOnly].iter() {
+            let full = Secp256k1::new();
+            let (sk, pk) = full.generate_keypair(&mut thread_rng()).unwrap();
+            let sig = full.sign(&msg, &sk).unwrap();
+
+            let s = Secp256k1::with_caps(caps);
+            let mut clones = vec![s.clone(), s.clone()];
+            // The clones outlive the context they were cloned from
+            drop(s);
+            for clone in clones.iter_mut() {
+                clone.randomize(&mut thread_rng());
+            }
+            let clone = clones[0].clone();
+            clones.clear();
+            assert_eq!(clone.caps, caps);
+            if caps != ContextFlag::VerifyOnly {
+                assert_eq!(clone.sign(&msg, &sk), Ok(sig));
+            }
+            if caps != ContextFlag::SignOnly {
+                assert_eq!(clone.verify(&msg, &sig, &pk), Ok(()));
+            }
+        }
+    }
+
+    #[test]
+    fn global_context() {
+        let global = Secp256k1::global();
+        assert_eq!(global as *const _, Secp256k1::global() as *const _);
+        assert_eq!(global.caps, ContextFlag::Full);
+
+        let mut msg = [0u8; 32];
+        thread_rng().fill_bytes(&mut msg);
+        let msg = Message::from_slice(&msg).unwrap();
+
+        let full = Secp256k1::new();
+        let (sk, pk) = global.generate_keypair(&mut thread_rng()).unwrap();
+        assert_eq!(PublicKey::from_secret_key(&full, &sk), Ok(pk));
+
+        let sig = global.sign(&msg, &sk).unwrap();
+        assert_eq!(sig, full.sign(&msg, &sk).unwrap());
+        assert_eq!(global.verify(&msg, &sig, &pk), Ok(()));
+        let sigr = global.sign_recoverable(&msg, &sk).unwrap();
+        assert_eq!(global.recover(&msg, &sigr), Ok(pk));
+
+        // Clones share the tables but can be blinded independently
+        let mut clone = global.clone();
+        clone.randomize(&mut thread_rng());
+        assert_eq!(clone.sign(&msg, &sk), Ok(sig));
+        assert_eq!(clone.verify(&msg, &sig, &pk), Ok(()));
+        let clone2 = clone.clone();
+        drop(clone);
+        assert_eq!(clone2.recover(&msg, &sigr), Ok(pk));
+        assert_eq!(global.sign(&msg, &sk), Ok(sig));
+    }
+
+    #[test]
+    fn memory_footprint() {
+        let full = Secp256k1::new().memory_footprint();
+        let vrfy = Secp256k1::with_caps(ContextFlag::VerifyOnly).memory_footprint();
+        let sign = Secp256k1::with_caps(ContextFlag::SignOnly).memory_footprint();
+        let none = Secp256k1::without_caps().memory_footprint();
+        assert!(full.context > 0 && full.gen_table > 0 && full.ecmult_table > 0);
+        assert_eq!(vrfy.gen_table, 0);
+        assert_eq!(vrfy.ecmult_table, full.ecmult_table);
+        assert_eq!(sign.ecmult_table, 0);
+        assert_eq!(sign.gen_table, full.gen_table);
+        assert_eq!(none.total(), none.context);
+        assert_eq!(Secp256k1::new().clone().memory_footprint(), full);
+
+        // Static contexts only report their role's tables, and allocate none
+        let global = Secp256k1::global().memory_footprint();
+        let lean = Secp256k1::with_caps_static(ContextFlag::VerifyOnly);
+        let footprint = lean.memory_footprint();
+        assert_eq!(footprint.ecmult_table, full.ecmult_table);
+        if global.ecmult_table_static {
+            assert!(footprint.ecmult_table_static);
+            assert_eq!(footprint.gen_table, 0);
+            assert!(footprint.heap() < vrfy.heap());
+            assert_eq!(global.heap(), global.context);
+        }
+        assert_eq!(lean.sign(&Message::from_slice(&[1; 32]).unwrap(), &ONE_KEY), Err(IncapableContext));
+    }
+
     #[test]
     fn recid_sanity_check() {
         let one = RecoveryId(1);
@@ -682,6 +1417,89 @@ mod tests {
         check_lax_sig!("3044022023ee4e95151b2fbbb08a72f35babe02830d14d54bd7ed1320e4751751d1baa4802206235245254f58fd1be6ff19ca291817da76da65c2f6d81d654b5185dd86b8acf");
     }
 
+    #[test]
+    fn signature_der_batch() {
+        let s = Secp256k1::new();
+        let mut input = vec![];
+        let mut offsets = vec![0];
+        let mut expected = vec![];
+        for i in 0..150 {
+            let mut msg = [0; 32];
+            thread_rng().fill_bytes(&mut msg);
+            let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+            let mut der = s.sign(&Message::from_slice(&msg).unwrap(), &sk).unwrap().serialize_der(&s);
+            if i % 7 == 3 {
+                // A trailing byte is rejected by the strict parser only
+                der.push(0);
+            }
+            expected.push((Signature::from_der(&s, &der), Signature::from_der_lax(&s, &der)));
+            input.extend_from_slice(&der);
+            offsets.push(input.len());
+        }
+        input.push(0x30);
+        offsets.push(input.len());
+        expected.push((Err(InvalidSignature), Err(InvalidSignature)));
+
+        let mut output = vec![Err(InvalidSignature); expected.len()];
+        Signature::from_der_batch(&s, &input, &offsets, &mut output);
+        assert_eq!(output, expected.iter().map(|e| e.0).collect::<Vec<_>>());
+        Signature::from_der_lax_batch(&s, &input, &offsets, &mut output);
+        assert_eq!(output, expected.iter().map(|e| e.1).collect::<Vec<_>>());
+        assert!(output[3].is_ok() && expected[3].0.is_err());
+    }
+
+    #[test]
+    fn signature_rsv_batch() {
+        let s = Secp256k1::new();
+        // Signatures 70 bytes apart, with junk in between
+        let mut input = vec![0xaa; 70 * 150];
+        let mut offsets = vec![];
+        for i in 0..150 {
+            let mut msg = [0; 32];
+            thread_rng().fill_bytes(&mut msg);
+            let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+            let (recid, compact) = s.sign_recoverable(&Message::from_slice(&msg).unwrap(), &sk)
+                                    .unwrap().serialize_compact(&s);
+            let rsv = &mut input[70 * i + 3..70 * i + 68];
+            rsv[..64].copy_from_slice(&compact);
+            rsv[64] = recid.to_i32() as u8;
+            match i % 10 {
+                1 => rsv[64] = 4,
+                2 => rsv[64] = 2,
+                3 => for b in &mut rsv[..32] { *b = 0xff },
+                4 => for b in &mut rsv[..32] { *b = 0 },
+                5 => {
+                    // Below the order, but in its upper half
+                    for b in &mut rsv[32..48] { *b = 0xff }
+                    rsv[47] = 0xfe;
+                    for b in &mut rsv[48..64] { *b = 0 }
+                }
+                _ => {}
+            }
+            offsets.push(70 * i + 3);
+        }
+
+        let mut output = vec![Err(InvalidSignature); offsets.len()];
+        RecoverableSignature::from_rsv_batch(&s, &input, &offsets, &mut output);
+        let mut strict = output.clone();
+        RecoverableSignature::from_rsv_batch_strict(&s, &input, &offsets, &mut strict);
+        for (i, &offset) in offsets.iter().enumerate() {
+            let rsv = &input[offset..offset + 65];
+            let expected = RecoveryId::from_i32(rsv[64] as i32)
+                .and_then(|recid| RecoverableSignature::from_compact(&s, &rsv[..64], recid))
+                .map_err(|_| InvalidSignature);
+            assert_eq!(output[i], expected);
+            match i % 10 {
+                1 | 3 => assert_eq!(output[i], Err(InvalidSignature)),
+                2 | 4 | 5 => {
+                    assert!(output[i].is_ok());
+                    assert_eq!(strict[i], Err(InvalidSignature));
+                }
+                _ => assert_eq!(strict[i], expected)
+            }
+        }
+    }
+
     #[test]
     fn sign_and_verify() {
         let mut s = Secp256k1::new();
@@ -782,6 +1600,160 @@ mod tests {
         assert!(s.recover(&msg, &sig).is_ok());
     }
 
+    #[test]
+    fn recover_batch() {
+        let mut s = Secp256k1::new();
+        s.randomize(&mut thread_rng());
+
+        // Enough items to span several FFI chunks
+        let mut input = Vec::new();
+        let mut expected = Vec::new();
+        for _ in 0..150 {
+            let mut msg = [0u8; 32];
+            thread_rng().fill_bytes(&mut msg);
+            let msg = Message::from_slice(&msg).unwrap();
+            let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+            input.push((msg, s.sign_recoverable(&msg, &sk).unwrap()));
+            expected.push(Ok(pk));
+        }
+        // Zero is not a valid sig
+        let msg = Message::from_slice(&[0x55; 32]).unwrap();
+        input[70] = (msg, RecoverableSignature::from_compact(&s, &[0; 64], RecoveryId(0)).unwrap());
+        expected[70] = Err(InvalidSignature);
+
+        let mut output = vec![Err(InvalidSignature); input.len()];
+        assert_eq!(s.recover_batch(&input, &mut output), Ok(()));
+        assert_eq!(output, expected);
+        for (&(ref msg, ref sig), out) in input.iter().zip(output.iter()) {
+            assert_eq!(&s.recover(msg, sig), out);
+        }
+
+        let sign = Secp256k1::with_caps(ContextFlag::SignOnly);
+        assert_eq!(sign.recover_batch(&input, &mut output), Err(IncapableContext));
+        assert!(s.recover_batch(&[], &mut []).is_ok());
+    }
+
+    #[test]
+    fn recover_address() {
+        let s = Secp256k1::new();
+
+        // The well-known address of the secret key 1
+        let msg = Message::from_slice(&[0x42; 32]).unwrap();
+        let sig = s.sign_recoverable(&msg, &ONE_KEY).unwrap();
+        assert_eq!(s.recover_address(&msg, &sig),
+                   Ok(hex!("7e5f4552091a69125d5dfcb7b8c2659029395bdf")));
+
+        let mut input = Vec::new();
+        for _ in 0..100 {
+            let mut msg = [0u8; 32];
+            thread_rng().fill_bytes(&mut msg);
+            let msg = Message::from_slice(&msg).unwrap();
+            let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+            input.push((msg, s.sign_recoverable(&msg, &sk).unwrap()));
+        }
+        input[65].1 = RecoverableSignature::from_compact(&s, &[0; 64], RecoveryId(0)).unwrap();
+
+        let mut output = vec![Err(IncapableContext); input.len()];
+        assert_eq!(s.recover_address_batch(&input, &mut output), Ok(()));
+        for (&(ref msg, ref sig), out) in input.iter().zip(output.iter()) {
+            assert_eq!(&s.recover_address(msg, sig), out);
+        }
+        assert_eq!(output[65], Err(InvalidSignature));
+
+        let sign = Secp256k1::with_caps(ContextFlag::SignOnly);
+        assert_eq!(sign.recover_address(&msg, &sig), Err(IncapableContext));
+        assert_eq!(sign.recover_address_batch(&input, &mut output), Err(IncapableContext));
+    }
+
+    #[test]
+    fn borrowed_views() {
+        let s = Secp256k1::new();
+        let msg = Message::from_slice(&[0x33; 32]).unwrap();
+        let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let sig = s.sign_recoverable(&msg, &sk).unwrap();
+        let (recid, compact) = sig.serialize_compact(&s);
+
+        // A receive buffer holding r || s || v followed by the public key
+        let mut buf = compact.to_vec();
+        buf.push(recid.to_i32() as u8);
+        buf.extend_from_slice(&pk.serialize_vec(&s, false));
+
+        let sig_ref = CompactSigRef::from_rsv(&buf[..65]).unwrap();
+        assert_eq!(sig_ref, CompactSigRef::new(&buf[..64], recid).unwrap());
+        assert_eq!(s.recover_ref(&msg, &sig_ref), Ok(pk));
+        assert_eq!(s.recover_address_ref(&msg, &sig_ref), s.recover_address(&msg, &sig));
+        let pk_ref = PubkeyRef::new(&buf[65..]).unwrap();
+        assert_eq!(pk_ref.parse(&s), Ok(pk));
+        assert_eq!(s.verify_ref(&msg, &sig_ref, &pk_ref), s.verify(&msg, &sig.to_standard(&s), &pk));
+        let compressed = pk.serialize_vec(&s, true);
+        assert_eq!(s.verify_ref(&msg, &sig_ref, &PubkeyRef::new(&compressed).unwrap()),
+                   s.verify(&msg, &sig.to_standard(&s), &pk));
+
+        let other = Message::from_slice(&[0x34; 32]).unwrap();
+        assert_eq!(s.verify_ref(&other, &sig_ref, &pk_ref), Err(IncorrectSignature));
+        assert_eq!(s.recover_ref(&other, &sig_ref), s.recover(&other, &sig));
+
+        // Overflowing r, and a public key which is not on the curve
+        let bad_sig = [0xff; 64];
+        let bad_sig = CompactSigRef::new(&bad_sig, recid).unwrap();
+        assert_eq!(s.recover_ref(&msg, &bad_sig), Err(InvalidSignature));
+        assert_eq!(s.verify_ref(&msg, &bad_sig, &pk_ref), Err(InvalidSignature));
+        let mut bad_pk = buf[65..].to_vec();
+        bad_pk[64] ^= 1;
+        let bad_pk = PubkeyRef::new(&bad_pk).unwrap();
+        assert_eq!(s.verify_ref(&msg, &sig_ref, &bad_pk), Err(InvalidPublicKey));
+        assert_eq!(bad_pk.parse(&s), Err(InvalidPublicKey));
+
+        assert_eq!(CompactSigRef::new(&buf[..63], recid), Err(InvalidSignature));
+        assert_eq!(CompactSigRef::from_rsv(&[0; 65][..]).map(|_| ()), Ok(()));
+        assert_eq!(CompactSigRef::from_rsv(&[4; 65][..]), Err(super::Error::InvalidRecoveryId));
+        assert_eq!(PubkeyRef::new(&buf[..64]), Err(InvalidPublicKey));
+
+        let sign = Secp256k1::with_caps(ContextFlag::SignOnly);
+        assert_eq!(sign.recover_ref(&msg, &sig_ref), Err(IncapableContext));
+        assert_eq!(sign.verify_ref(&msg, &sig_ref, &pk_ref), Err(IncapableContext));
+    }
+
+    #[test]
+    fn verify_batch() {
+        let s = Secp256k1::new();
+
+        let mut input = Vec::new();
+        for _ in 0..150 {
+            let mut msg = [0u8; 32];
+            thread_rng().fill_bytes(&mut msg);
+            let msg = Message::from_slice(&msg).unwrap();
+            let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+            input.push((msg, s.sign_recoverable(&msg, &sk).unwrap(), pk));
+        }
+        assert_eq!(s.verify_batch(&input), Ok(()));
+        assert_eq!(s.verify_batch(&input[..1]), Ok(()));
+        assert_eq!(s.verify_batch(&[]), Ok(()));
+        let mut output = vec![Err(IncorrectSignature); input.len()];
+        assert_eq!(s.verify_batch_each(&input, &mut output), Ok(()));
+        assert!(output.iter().all(|res| res.is_ok()));
+
+        // Wrong key, and right signature with the wrong recovery ID
+        let mut bad = input.clone();
+        bad[3].2 = input[4].2;
+        let (recid, compact) = input[100].1.serialize_compact(&s);
+        let recid = RecoveryId::from_i32(recid.to_i32() ^ 1).unwrap();
+        bad[100].1 = RecoverableSignature::from_compact(&s, &compact, recid).unwrap();
+        assert_eq!(s.verify_batch(&bad), Err(IncorrectSignature));
+        assert_eq!(s.verify_batch_each(&bad, &mut output), Ok(()));
+        for (i, res) in output.iter().enumerate() {
+            assert_eq!(res.is_ok(), i != 3 && i != 100);
+        }
+
+        bad[3].2 = PublicKey::new();
+        assert_eq!(s.verify_batch(&bad), Err(InvalidPublicKey));
+        assert_eq!(s.verify_batch_each(&bad, &mut output), Ok(()));
+        assert_eq!(output[3], Err(InvalidPublicKey));
+
+        let sign = Secp256k1::with_caps(ContextFlag::SignOnly);
+        assert_eq!(sign.verify_batch(&input), Err(IncapableContext));
+    }
+
     #[test]
     fn test_bad_slice() {
         let s = Secp256k1::new();
@@ -942,5 +1914,24 @@ mod benches {
             black_box(res);
         });
     }
+
+    #[bench]
+    pub fn bench_recover_batch(bh: &mut Bencher) {
+        let s = Secp256k1::new();
+        let mut input = Vec::new();
+        for _ in 0..256 {
+            let mut msg = [0u8; 32];
+            thread_rng().fill_bytes(&mut msg);
+            let msg = Message::from_slice(&msg).unwrap();
+            let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+            input.push((msg, s.sign_recoverable(&msg, &sk).unwrap()));
+        }
+        let mut output = vec![Err(::Error::InvalidSignature); input.len()];
+
+        bh.iter(|| {
+            s.recover_batch(&input, &mut output).unwrap();
+            black_box(&output);
+        });
+    }
 }
 
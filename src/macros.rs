@@ -145,3 +145,36 @@ macro_rules! impl_raw_debug {
      }
 }
 
+
+// Times the rest of the enclosing block as `$n` (by default one) operations
+// of kind `metrics::Op::$op` on the context `$secp`. Expands to nothing,
+// evaluating none of its arguments, without the `metrics` feature.
+#[cfg(feature = "metrics")]
+macro_rules! metrics_timer {
+    ($secp:expr, $op:ident) => {
+        metrics_timer!($secp, $op, 1);
+    };
+    ($secp:expr, $op:ident, $n:expr) => {
+        let _timer = ::metrics::Timer::new(&$secp.metrics, ::metrics::Op::$op, $n as u64);
+    };
+}
+
+#[cfg(not(feature = "metrics"))]
+macro_rules! metrics_timer {
+    ($($arg:tt)*) => {};
+}
+
+// Wraps the rest of the enclosing block in the span `$name` over `$items`
+// items, see `metrics::SpanHooks`. Expands to nothing without the `metrics`
+// feature.
+#[cfg(feature = "metrics")]
+macro_rules! metrics_span {
+    ($name:expr, $items:expr) => {
+        let _span = ::metrics::Span::enter($name, $items);
+    };
+}
+
+#[cfg(not(feature = "metrics"))]
+macro_rules! metrics_span {
+    ($($arg:tt)*) => {};
+}
@@ -0,0 +1,357 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Metrics
+//! Operation counters and latency histograms, kept per context, and span
+//! hooks around the batch and parallel engines. Requires the `metrics`
+//! feature; without it none of this is compiled and the instrumented
+//! functions are unchanged.
+//!
+
+use std::{fmt, ptr};
+use std::sync::atomic::{AtomicPtr, AtomicU64, Ordering};
+use std::time::Instant;
+
+/// Number of latency buckets of a histogram
+pub const BUCKETS: usize = 24;
+
+/// A top-level operation
+#[derive(Copy, Clone, PartialEq, Eq, Debug, Hash)]
+pub enum Op {
+    /// Signing, including `session::SigningSession`
+    Sign,
+    /// Verification, including batch verification
+    Verify,
+    /// Public key (or address) recovery
+    Recover,
+    /// Shared secret computation
+    Ecdh,
+    /// Public key derivation from secret keys
+    Keygen,
+    /// Tweaking (adding to, multiplying or inverting) a key
+    Tweak,
+    /// Adding up public keys
+    Combine,
+    /// Parsing a key or signature
+    Parse,
+    /// Serializing a key or signature
+    Serialize,
+    /// `Secp256k1::with_caps` and the constructors built on it
+    ContextCreate,
+    /// `Secp256k1::clone`
+    ContextClone
+}
+
+/// Number of operations in `Op`
+pub const OP_COUNT: usize = 11;
+
+impl Op {
+    /// Every operation, in declaration order
+    pub const ALL: [Op; OP_COUNT] = [Op::Sign, Op::Verify, Op::Recover, Op::Ecdh, Op::Keygen, Op::Tweak,
+                                     Op::Combine, Op::Parse, Op::Serialize, Op::ContextCreate, Op::ContextClone];
+
+    /// A lower-case name for the operation, usable as a metric label
+    pub fn name(&self) -> &'static str {
+        match *self {
+            Op::Sign => "sign",
+            Op::Verify => "verify",
+            Op::Recover => "recover",
+            Op::Ecdh => "ecdh",
+            Op::Keygen => "keygen",
+            Op::Tweak => "tweak",
+            Op::Combine => "combine",
+            Op::Parse => "parse",
+            Op::Serialize => "serialize",
+            Op::ContextCreate => "context_create",
+            Op::ContextClone => "context_clone"
+        }
+    }
+}
+
+impl fmt::Display for Op {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.write_str(self.name())
+    }
+}
+
+/// The exclusive upper bound, in nanoseconds, of the latencies counted in
+/// histogram bucket `i`, or `None` for the last bucket, which has no bound.
+/// Bucket 0 counts latencies below 128ns and each further bucket doubles
+/// the bound.
+pub fn bucket_bound_nanos(i: usize) -> Option<u64> {
+    if i + 1 < BUCKETS { Some(128 << i) } else { None }
+}
+
+fn bucket(nanos: u64) -> usize {
+    let b = (64 - (nanos >> 7).leading_zeros()) as usize;
+    if b < BUCKETS { b } else { BUCKETS - 1 }
+}
+
+#[derive(Default)]
+struct OpStats {
+    count: AtomicU64,
+    total_nanos: AtomicU64,
+    buckets: [AtomicU64; BUCKETS]
+}
+
+/// The counters of one context, shared with its clones. Updates are relaxed
+/// atomic additions, so recording never blocks, and a snapshot taken while
+/// other threads record is not necessarily consistent across operations.
+#[derive(Default)]
+pub struct Metrics {
+    ops: [OpStats; OP_COUNT]
+}
+
+impl Metrics {
+    /// Creates zeroed counters
+    pub fn new() -> Metrics {
+        Metrics::default()
+    }
+
+    /// Records `n` operations of kind `op` which took `nanos` nanoseconds
+    /// together. Each counts as one observation of `nanos / n` in the
+    /// histogram, so batch and single operations share a scale.
+    pub fn record(&self, op: Op, n: u64, nanos: u64) {
+        if n == 0 {
+            return;
+        }
+        let stats = &self.ops[op as usize];
+        stats.count.fetch_add(n, Ordering::Relaxed);
+        stats.total_nanos.fetch_add(nanos, Ordering::Relaxed);
+        stats.buckets[bucket(nanos / n)].fetch_add(n, Ordering::Relaxed);
+    }
+
+    /// Copies out the current counts
+    pub fn snapshot(&self) -> Snapshot {
+        let mut snapshot = Snapshot { ops: [OpSnapshot::default(); OP_COUNT] };
+        for (out, stats) in snapshot.ops.iter_mut().zip(self.ops.iter()) {
+            out.count = stats.count.load(Ordering::Relaxed);
+            out.total_nanos = stats.total_nanos.load(Ordering::Relaxed);
+            for (out, bucket) in out.buckets.iter_mut().zip(stats.buckets.iter()) {
+                *out = bucket.load(Ordering::Relaxed);
+            }
+        }
+        snapshot
+    }
+
+    /// Zeroes all counters
+    pub fn reset(&self) {
+        for stats in self.ops.iter() {
+            stats.count.store(0, Ordering::Relaxed);
+            stats.total_nanos.store(0, Ordering::Relaxed);
+            for bucket in stats.buckets.iter() {
+                bucket.store(0, Ordering::Relaxed);
+            }
+        }
+    }
+}
+
+impl fmt::Debug for Metrics {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "Metrics(..)")
+    }
+}
+
+/// The counts of one operation at the time of a snapshot
+#[derive(Copy, Clone, PartialEq, Eq, Debug, Default)]
+pub struct OpSnapshot {
+    /// Number of operations
+    pub count: u64,
+    /// Total time spent in them, in nanoseconds
+    pub total_nanos: u64,
+    /// Number of operations per latency bucket (see `bucket_bound_nanos`).
+    /// The counts are not cumulative, unlike Prometheus `le` buckets.
+    pub buckets: [u64; BUCKETS]
+}
+
+/// The counts of every operation at the time of a snapshot
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub struct Snapshot {
+    ops: [OpSnapshot; OP_COUNT]
+}
+
+impl Snapshot {
+    /// The counts of `op`
+    pub fn get(&self, op: Op) -> &OpSnapshot {
+        &self.ops[op as usize]
+    }
+
+    /// Every operation with its counts, in the order of `Op::ALL`
+    pub fn iter<'a>(&'a self) -> impl Iterator<Item = (Op, &'a OpSnapshot)> + 'a {
+        Op::ALL.iter().cloned().zip(self.ops.iter())
+    }
+}
+
+/// Records the time from its creation until it is dropped as `n`
+/// operations of one kind
+pub struct Timer<'a> {
+    metrics: &'a Metrics,
+    op: Op,
+    n: u64,
+    start: Instant
+}
+
+impl<'a> Timer<'a> {
+    /// Starts timing `n` operations of kind `op`
+    #[inline]
+    pub fn new(metrics: &'a Metrics, op: Op, n: u64) -> Timer<'a> {
+        Timer { metrics: metrics, op: op, n: n, start: Instant::now() }
+    }
+}
+
+impl<'a> Drop for Timer<'a> {
+    fn drop(&mut self) {
+        let elapsed = self.start.elapsed();
+        let nanos = elapsed.as_secs() * 1_000_000_000 + elapsed.subsec_nanos() as u64;
+        self.metrics.record(self.op, self.n, nanos);
+    }
+}
+
+/// Functions called when a batch or parallel engine (such as
+/// `Secp256k1::recover_batch` or `Secp256k1::par_verify`) starts and
+/// finishes, with the engine's name and, on entry, the number of items.
+/// Spans nest, and always exit in reverse order on the entering thread, so a
+/// tracing bridge can keep its entered spans on a thread-local stack.
+#[derive(Copy, Clone, Debug)]
+pub struct SpanHooks {
+    /// Called on entry
+    pub enter: fn(name: &'static str, items: usize),
+    /// Called on exit
+    pub exit: fn(name: &'static str)
+}
+
+static SPAN_HOOKS: AtomicPtr<SpanHooks> = AtomicPtr::new(0 as *mut SpanHooks);
+
+/// Installs process-wide span hooks, or removes them with `None`. Spans
+/// already entered exit through the hooks they entered with.
+pub fn set_span_hooks(hooks: Option<&'static SpanHooks>) {
+    let hooks = hooks.map_or(ptr::null_mut(), |hooks| hooks as *const SpanHooks as *mut SpanHooks);
+    SPAN_HOOKS.store(hooks, Ordering::Release);
+}
+
+/// An entered span, exited when dropped
+pub struct Span {
+    name: &'static str,
+    hooks: Option<&'static SpanHooks>
+}
+
+impl Span {
+    /// Enters the span `name` over `items` items, if hooks are installed
+    #[inline]
+    pub fn enter(name: &'static str, items: usize) -> Span {
+        let hooks = unsafe { SPAN_HOOKS.load(Ordering::Acquire).as_ref() };
+        if let Some(hooks) = hooks {
+            (hooks.enter)(name, items);
+        }
+        Span { name: name, hooks: hooks }
+    }
+}
+
+impl Drop for Span {
+    fn drop(&mut self) {
+        if let Some(hooks) = self.hooks {
+            (hooks.exit)(self.name);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::cell::RefCell;
+
+    use rand::thread_rng;
+
+    use super::super::{Secp256k1, Message};
+    use super::{Metrics, Op, SpanHooks, Span, set_span_hooks, bucket, bucket_bound_nanos, BUCKETS};
+
+    #[test]
+    fn metrics_buckets() {
+        assert_eq!(bucket(0), 0);
+        assert_eq!(bucket(127), 0);
+        assert_eq!(bucket(128), 1);
+        assert_eq!(bucket(255), 1);
+        assert_eq!(bucket(256), 2);
+        assert_eq!(bucket(!0), BUCKETS - 1);
+        for i in 0..BUCKETS - 1 {
+            let bound = bucket_bound_nanos(i).unwrap();
+            assert_eq!(bucket(bound - 1), i);
+            assert_eq!(bucket(bound), i + 1);
+        }
+        assert_eq!(bucket_bound_nanos(BUCKETS - 1), None);
+
+        let metrics = Metrics::new();
+        metrics.record(Op::Verify, 4, 4000);
+        metrics.record(Op::Verify, 0, 4000);
+        let snapshot = metrics.snapshot();
+        assert_eq!(snapshot.get(Op::Verify).count, 4);
+        assert_eq!(snapshot.get(Op::Verify).total_nanos, 4000);
+        assert_eq!(snapshot.get(Op::Verify).buckets[bucket(1000)], 4);
+        assert_eq!(snapshot.iter().filter(|&(_, ops)| ops.count != 0).count(), 1);
+        metrics.reset();
+        assert_eq!(metrics.snapshot().get(Op::Verify).count, 0);
+    }
+
+    #[test]
+    fn metrics_counts() {
+        let s = Secp256k1::new();
+        let snapshot = s.metrics().snapshot();
+        assert_eq!(snapshot.get(Op::ContextCreate).count, 1);
+
+        let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let msg = Message::from_slice(&[0xab; 32]).unwrap();
+        let sig = s.sign_recoverable(&msg, &sk).unwrap();
+        let input = vec![(msg, sig); 10];
+        let mut output = vec![Ok(pk); 10];
+        s.recover_batch(&input, &mut output).unwrap();
+
+        // Clones share the counters
+        let clone = s.clone();
+        assert!(clone.verify(&msg, &sig.to_standard(&s), &pk).is_ok());
+
+        let snapshot = s.metrics().snapshot();
+        assert_eq!(snapshot.get(Op::Keygen).count, 1);
+        assert_eq!(snapshot.get(Op::Sign).count, 1);
+        assert_eq!(snapshot.get(Op::Recover).count, 10);
+        assert_eq!(snapshot.get(Op::Verify).count, 1);
+        assert_eq!(snapshot.get(Op::ContextClone).count, 1);
+        assert_eq!(snapshot.get(Op::Recover).buckets.iter().sum::<u64>(), 10);
+    }
+
+    thread_local!(static SPANS: RefCell<Vec<(&'static str, usize)>> = RefCell::new(vec![]));
+
+    fn enter(name: &'static str, items: usize) {
+        SPANS.with(|spans| spans.borrow_mut().push((name, items)));
+    }
+
+    fn exit(name: &'static str) {
+        SPANS.with(|spans| spans.borrow_mut().push((name, !0)));
+    }
+
+    static HOOKS: SpanHooks = SpanHooks { enter: enter, exit: exit };
+
+    #[test]
+    fn metrics_spans() {
+        // Other tests run concurrently, but the log is per thread
+        set_span_hooks(Some(&HOOKS));
+        {
+            let _outer = Span::enter("outer", 3);
+            let _inner = Span::enter("inner", 1);
+        }
+        set_span_hooks(None);
+        drop(Span::enter("ignored", 0));
+        SPANS.with(|spans| {
+            let spans: Vec<_> = spans.borrow().iter().cloned().filter(|&(name, _)| name == "outer" || name == "inner")
+                                     .collect();
+            assert_eq!(spans, vec![("outer", 3), ("inner", 1), ("inner", !0), ("outer", !0)]);
+        });
+    }
+}
@@ -0,0 +1,167 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Parallel batch execution
+//! Spreads large batches of recoveries and verifications over several
+//! threads sharing one context. Requires the `parallel` feature.
+//!
+
+use std::cmp;
+use std::sync::Mutex;
+use std::thread;
+
+use super::{Secp256k1, ContextFlag, Error, Message, Signature, RecoverableSignature};
+use key::PublicKey;
+use ffi;
+
+/// Number of items a worker takes at a time. A few FFI batches per chunk
+/// keeps the scheduling overhead negligible while the chunk's inputs and
+/// outputs stay cache-resident.
+pub const CHUNK_SIZE: usize = 4 * ffi::SECP256K1_EXT_BATCH_MAX;
+
+/// Runs `f` over matching chunks of `input` and `output` on up to `threads`
+/// threads (`0` meaning one per available core). Idle workers take the next
+/// chunk from a shared queue, so slow chunks do not hold up the rest, and
+/// every chunk writes only the outputs of its own inputs, so the result order
+/// does not depend on scheduling.
+fn run<I, O, F>(threads: usize, input: &[I], output: &mut [O], f: F)
+    where I: Sync, O: Send, F: Fn(&[I], &mut [O]) + Sync
+{
+    assert_eq!(input.len(), output.len(), "input and output lengths differ");
+
+    let threads = if threads == 0 {
+        thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+    } else {
+        threads
+    };
+    let chunks = (input.len() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    let threads = cmp::max(1, cmp::min(threads, chunks));
+
+    let queue = Mutex::new(input.chunks(CHUNK_SIZE).zip(output.chunks_mut(CHUNK_SIZE)));
+    let work = || loop {
+        // Release the lock before doing any work on the chunk
+        let next = queue.lock().unwrap().next();
+        match next {
+            Some((input, output)) => f(input, output),
+            None => break
+        }
+    };
+
+    thread::scope(|scope| {
+        for _ in 1..threads {
+            scope.spawn(&work);
+        }
+        work();
+    });
+}
+
+impl Secp256k1 {
+    /// Parallel version of `recover_batch`, using up to `threads` threads
+    /// (`0` for one per available core). `output[i]` receives the result for
+    /// `input[i]`. Requires a verify-capable context.
+    ///
+    /// Panics if `input` and `output` differ in length.
+    pub fn par_recover(&self, threads: usize, input: &[(Message, RecoverableSignature)],
+                       output: &mut [Result<PublicKey, Error>])
+                       -> Result<(), Error> {
+        metrics_span!("par_recover", input.len());
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+
+        run(threads, input, output, |input, output| {
+            let res = self.recover_batch(input, output);
+            debug_assert!(res.is_ok());
+        });
+        Ok(())
+    }
+
+    /// Verifies a batch of (message, signature, public key) triples on up to
+    /// `threads` threads (`0` for one per available core), writing the result
+    /// of `verify` for `input[i]` to `output[i]`. Requires a verify-capable
+    /// context.
+    ///
+    /// Panics if `input` and `output` differ in length.
+    pub fn par_verify(&self, threads: usize, input: &[(Message, Signature, PublicKey)],
+                      output: &mut [Result<(), Error>])
+                      -> Result<(), Error> {
+        metrics_span!("par_verify", input.len());
+        if self.caps == ContextFlag::SignOnly || self.caps == ContextFlag::None {
+            return Err(Error::IncapableContext);
+        }
+
+        run(threads, input, output, |input, output| {
+            for (&(ref msg, ref sig, ref pk), out) in input.iter().zip(output.iter_mut()) {
+                *out = self.verify(msg, sig, pk);
+            }
+        });
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use rand::thread_rng;
+
+    use super::super::{Secp256k1, RecoverableSignature, RecoveryId, ContextFlag};
+    use super::super::Error::{IncapableContext, IncorrectSignature, InvalidSignature};
+    use super::super::tests::random_message;
+    use super::CHUNK_SIZE;
+
+    #[test]
+    fn par_recover() {
+        let s = Secp256k1::new();
+
+        let mut input = Vec::new();
+        for _ in 0..(3 * CHUNK_SIZE + 7) {
+            let msg = random_message();
+            let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+            input.push((msg, s.sign_recoverable(&msg, &sk).unwrap()));
+        }
+        input[CHUNK_SIZE + 1].1 = RecoverableSignature::from_compact(&s, &[0; 64], RecoveryId(0)).unwrap();
+
+        let mut expected = vec![Err(InvalidSignature); input.len()];
+        assert!(s.recover_batch(&input, &mut expected).is_ok());
+        assert_eq!(expected[CHUNK_SIZE + 1], Err(InvalidSignature));
+
+        for &threads in [0, 1, 2, 3, 8].iter() {
+            let mut output = vec![Err(InvalidSignature); input.len()];
+            assert_eq!(s.par_recover(threads, &input, &mut output), Ok(()));
+            assert_eq!(output, expected);
+        }
+
+        let sign = Secp256k1::with_caps(ContextFlag::SignOnly);
+        let mut output = vec![Err(InvalidSignature); input.len()];
+        assert_eq!(sign.par_recover(2, &input, &mut output), Err(IncapableContext));
+        assert!(s.par_recover(4, &[], &mut []).is_ok());
+    }
+
+    #[test]
+    fn par_verify() {
+        let s = Secp256k1::new();
+
+        let mut input = Vec::new();
+        for _ in 0..(2 * CHUNK_SIZE + 3) {
+            let msg = random_message();
+            let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+            input.push((msg, s.sign(&msg, &sk).unwrap(), pk));
+        }
+        let bad = 2 * CHUNK_SIZE;
+        input[bad].0 = random_message();
+
+        let mut output = vec![Ok(()); input.len()];
+        assert_eq!(s.par_verify(4, &input, &mut output), Ok(()));
+        for (i, out) in output.iter().enumerate() {
+            assert_eq!(*out, if i == bad { Err(IncorrectSignature) } else { Ok(()) });
+        }
+    }
+}
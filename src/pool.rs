@@ -0,0 +1,216 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Context pools
+//! Per-thread contexts with independently refreshed blinding
+//!
+
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::fmt;
+use std::sync::{Arc, Weak};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::time::{Duration, Instant};
+
+use rand::thread_rng;
+
+use super::Secp256k1;
+
+/// When the contexts of a `ContextPool` are rerandomized
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub struct PoolConfig {
+    /// Rerandomize a thread's context after this many uses, `0` meaning
+    /// never (default 1024)
+    pub reseed_uses: u64,
+    /// Rerandomize a thread's context when it was last randomized this long
+    /// ago, if set (default `None`)
+    pub reseed_period: Option<Duration>
+}
+
+impl Default for PoolConfig {
+    fn default() -> PoolConfig {
+        PoolConfig { reseed_uses: 1024, reseed_period: None }
+    }
+}
+
+struct Inner {
+    id: usize,
+    base: Secp256k1,
+    config: PoolConfig
+}
+
+struct Entry {
+    pool: Weak<Inner>,
+    secp: Secp256k1,
+    uses: u64,
+    seeded: Instant
+}
+
+impl Entry {
+    fn new(inner: &Arc<Inner>) -> Entry {
+        let mut secp = inner.base.clone();
+        secp.randomize(&mut thread_rng());
+        Entry { pool: Arc::downgrade(inner), secp: secp, uses: 0, seeded: Instant::now() }
+    }
+
+    fn reseed_due(&self, config: &PoolConfig) -> bool {
+        (config.reseed_uses != 0 && self.uses >= config.reseed_uses) ||
+            config.reseed_period.map_or(false, |period| self.seeded.elapsed() >= period)
+    }
+}
+
+static NEXT_ID: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    // This thread's context of every pool it has used, by pool id
+    static CONTEXTS: RefCell<HashMap<usize, Entry>> = RefCell::new(HashMap::new());
+}
+
+/// Hands out one context per thread, each a clone of a base context, so all
+/// of them share its precomputed tables (by default the compiled-in tables
+/// of `Secp256k1::global`), caches and metrics. Each thread's context has
+/// its own blinding, randomized when the thread first uses it and again on
+/// the schedule of the pool's `PoolConfig`, so no thread needs exclusive
+/// access to a shared context to refresh it, and using the pool takes no
+/// locks.
+///
+/// A thread's context is freed when the thread exits, or, after the pool is
+/// dropped, the next time the thread starts using a new pool.
+pub struct ContextPool {
+    inner: Arc<Inner>
+}
+
+impl ContextPool {
+    /// Creates a pool of clones of `Secp256k1::global()`
+    pub fn new(config: PoolConfig) -> ContextPool {
+        ContextPool::with_base(Secp256k1::global(), config)
+    }
+
+    /// Creates a pool of clones of `base`
+    pub fn with_base(base: &Secp256k1, config: PoolConfig) -> ContextPool {
+        ContextPool {
+            inner: Arc::new(Inner {
+                id: NEXT_ID.fetch_add(1, Ordering::Relaxed),
+                base: base.clone(),
+                config: config
+            })
+        }
+    }
+
+    /// The configuration of the pool
+    pub fn config(&self) -> &PoolConfig {
+        &self.inner.config
+    }
+
+    /// Runs `f` on this thread's context, rerandomizing it first if it is
+    /// due. A nested call on the same thread gets a context of its own.
+    pub fn with<F, R>(&self, f: F) -> R
+        where F: FnOnce(&Secp256k1) -> R
+    {
+        let inner = &self.inner;
+        // Take the entry out for the duration of `f`, so that `f` may use
+        // the pool itself
+        let entry = CONTEXTS.with(|contexts| contexts.borrow_mut().remove(&inner.id));
+        let (mut entry, fresh) = match entry {
+            Some(entry) => (entry, false),
+            None => (Entry::new(inner), true)
+        };
+        if entry.reseed_due(&inner.config) {
+            entry.secp.randomize(&mut thread_rng());
+            entry.uses = 0;
+            entry.seeded = Instant::now();
+        }
+        entry.uses += 1;
+
+        let ret = f(&entry.secp);
+
+        CONTEXTS.with(|contexts| {
+            let mut contexts = contexts.borrow_mut();
+            if !contexts.contains_key(&inner.id) {
+                // Free the contexts of dropped pools when starting on a new one
+                if fresh {
+                    contexts.retain(|_, entry| entry.pool.upgrade().is_some());
+                }
+                contexts.insert(inner.id, entry);
+            }
+        });
+        ret
+    }
+}
+
+impl fmt::Debug for ContextPool {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "ContextPool {{ config: {:?} }}", self.inner.config)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::{Arc, Barrier};
+    use std::thread;
+    use std::time::Duration;
+
+    use rand::thread_rng;
+
+    use super::super::{Secp256k1, Message, ContextFlag};
+    use super::{ContextPool, PoolConfig, CONTEXTS};
+
+    #[test]
+    fn pool_per_thread() {
+        let pool = Arc::new(ContextPool::new(PoolConfig { reseed_uses: 3, ..Default::default() }));
+        let s = Secp256k1::new();
+        let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let msg = Message::from_slice(&[0x42; 32]).unwrap();
+        let expected = s.sign(&msg, &sk).unwrap();
+
+        // All threads hold their contexts at once, so their addresses differ
+        let barrier = Arc::new(Barrier::new(4));
+        let threads: Vec<_> = (0..4).map(|_| {
+            let (pool, barrier) = (pool.clone(), barrier.clone());
+            thread::spawn(move || {
+                let ctx = pool.with(|secp| secp.ctx as usize);
+                barrier.wait();
+                for _ in 0..10 {
+                    // Blinding does not change signatures
+                    assert_eq!(pool.with(|secp| secp.sign(&msg, &sk).unwrap()), expected);
+                    assert_eq!(pool.with(|secp| secp.ctx as usize), ctx);
+                }
+                ctx
+            })
+        }).collect();
+        let mut ctxs: Vec<_> = threads.into_iter().map(|t| t.join().unwrap()).collect();
+        ctxs.sort();
+        ctxs.dedup();
+        assert_eq!(ctxs.len(), 4);
+        assert!(pool.with(|secp| secp.verify(&msg, &expected, &pk)).is_ok());
+
+        // Nested use gets a second context
+        let pool = ContextPool::with_base(&Secp256k1::with_caps(ContextFlag::SignOnly),
+                                          PoolConfig { reseed_uses: 0, reseed_period: Some(Duration::from_millis(1)) });
+        let (outer, inner) = pool.with(|outer| (outer.ctx as usize, pool.with(|inner| inner.ctx as usize)));
+        assert!(outer != inner);
+        assert!(pool.with(|secp| secp.sign(&msg, &sk)).is_ok());
+    }
+
+    #[test]
+    fn pool_frees_contexts() {
+        let count = || CONTEXTS.with(|contexts| contexts.borrow().len());
+        let before = count();
+        let pool = ContextPool::new(Default::default());
+        pool.with(|_| ());
+        assert_eq!(count(), before + 1);
+        drop(pool);
+        let pool = ContextPool::new(Default::default());
+        pool.with(|_| ());
+        assert_eq!(count(), before + 1);
+    }
+}
@@ -0,0 +1,532 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Verification service
+//! Coalesces individual verification and recovery requests, for example
+//! from async tasks, into batches which run on a dedicated thread pool.
+//! Requires the `service` feature.
+//!
+
+use std::{cmp, fmt, mem, panic, thread};
+use std::future::Future;
+use std::pin::Pin;
+use std::sync::{Arc, Condvar, Mutex};
+use std::task::{Context, Poll, Waker};
+use std::time::{Duration, Instant};
+
+use super::{Secp256k1, Error, Message, Signature, RecoverableSignature};
+use key::PublicKey;
+use ffi;
+
+/// Configuration of a `VerifyService`
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub struct ServiceConfig {
+    /// Largest number of requests of one kind run as one batch; a batch
+    /// starts as soon as this many are queued (default
+    /// `4 * ffi::SECP256K1_EXT_BATCH_MAX`)
+    pub max_batch: usize,
+    /// Longest time a request waits for its batch to fill up before the
+    /// batch starts anyway (default 1ms)
+    pub max_delay: Duration,
+    /// Number of worker threads, `0` meaning one per available core
+    /// (default `0`)
+    pub threads: usize
+}
+
+impl Default for ServiceConfig {
+    fn default() -> ServiceConfig {
+        ServiceConfig {
+            max_batch: 4 * ffi::SECP256K1_EXT_BATCH_MAX,
+            max_delay: Duration::from_millis(1),
+            threads: 0
+        }
+    }
+}
+
+// The result of one request, filled in by a worker: the value, the waker of
+// the task polling for it, and whether the batch of the request panicked
+struct Slot<T> {
+    state: Mutex<(Option<T>, Option<Waker>, bool)>,
+    ready: Condvar
+}
+
+impl<T> Slot<T> {
+    fn new() -> Arc<Slot<T>> {
+        Arc::new(Slot { state: Mutex::new((None, None, false)), ready: Condvar::new() })
+    }
+
+    fn resolve(&self, value: T) {
+        self.finish(|state| state.0 = Some(value));
+    }
+
+    fn fail(&self) {
+        self.finish(|state| state.2 = true);
+    }
+
+    fn finish<F>(&self, set: F)
+        where F: FnOnce(&mut (Option<T>, Option<Waker>, bool))
+    {
+        let waker = {
+            let mut state = self.state.lock().unwrap();
+            set(&mut state);
+            state.1.take()
+        };
+        self.ready.notify_all();
+        if let Some(waker) = waker {
+            waker.wake();
+        }
+    }
+}
+
+const FAILED: &'static str = "VerifyService: the batch of this request panicked";
+
+// The requests of a running batch, resolved in order. Those not resolved
+// when it is dropped, because the batch panicked, fail.
+struct Pending<'a, I: 'a, T: 'a> {
+    requests: &'a [(I, Arc<Slot<T>>)],
+    resolved: usize
+}
+
+impl<'a, I, T> Pending<'a, I, T> {
+    fn new(requests: &'a [(I, Arc<Slot<T>>)]) -> Pending<'a, I, T> {
+        Pending { requests: requests, resolved: 0 }
+    }
+
+    fn resolve(&mut self, value: T) {
+        self.requests[self.resolved].1.resolve(value);
+        self.resolved += 1;
+    }
+}
+
+impl<'a, I, T> Drop for Pending<'a, I, T> {
+    fn drop(&mut self) {
+        for &(_, ref slot) in &self.requests[self.resolved..] {
+            slot.fail();
+        }
+    }
+}
+
+/// The pending result of a request to a `VerifyService`. Await it from
+/// async code, or block on it with `wait`.
+pub struct Response<T> {
+    slot: Arc<Slot<T>>
+}
+
+impl<T> Response<T> {
+    /// Blocks the current thread until the result is available.
+    ///
+    /// Panics if the batch holding the request panicked.
+    pub fn wait(self) -> T {
+        let mut state = self.slot.state.lock().unwrap();
+        loop {
+            if let Some(value) = state.0.take() {
+                return value;
+            }
+            if state.2 {
+                panic!("{}", FAILED);
+            }
+            state = self.slot.ready.wait(state).unwrap();
+        }
+    }
+}
+
+impl<T> Future for Response<T> {
+    type Output = T;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context) -> Poll<T> {
+        let mut state = self.slot.state.lock().unwrap();
+        match state.0.take() {
+            Some(value) => Poll::Ready(value),
+            None if state.2 => panic!("{}", FAILED),
+            None => {
+                state.1 = Some(cx.waker().clone());
+                Poll::Pending
+            }
+        }
+    }
+}
+
+impl<T> fmt::Debug for Response<T> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "Response(..)")
+    }
+}
+
+type VerifyRequest = ((Message, Signature, PublicKey), Arc<Slot<Result<(), Error>>>);
+type VerifyRecoverableRequest = ((Message, RecoverableSignature, PublicKey), Arc<Slot<Result<(), Error>>>);
+type RecoverRequest = ((Message, RecoverableSignature), Arc<Slot<Result<PublicKey, Error>>>);
+
+// Requests of one kind waiting for a batch
+struct Queue<T> {
+    items: Vec<T>,
+    // When the oldest queued request arrived
+    since: Option<Instant>
+}
+
+impl<T> Queue<T> {
+    fn new() -> Queue<T> {
+        Queue { items: Vec::new(), since: None }
+    }
+
+    // Whether the queue was empty
+    fn push(&mut self, item: T) -> bool {
+        self.items.push(item);
+        if self.since.is_none() {
+            self.since = Some(Instant::now());
+            true
+        } else {
+            false
+        }
+    }
+
+    fn deadline(&self, config: &ServiceConfig) -> Option<Instant> {
+        self.since.map(|since| since + config.max_delay)
+    }
+
+    fn ready(&self, config: &ServiceConfig, now: Instant, flush: bool) -> bool {
+        !self.items.is_empty() &&
+            (flush || self.items.len() >= config.max_batch || self.deadline(config).map_or(false, |d| d <= now))
+    }
+
+    // Takes the oldest `max` requests. Any left over keep the arrival time of
+    // the batch, so they are already due.
+    fn take(&mut self, max: usize) -> Vec<T> {
+        let rest = if self.items.len() > max { self.items.split_off(max) } else { Vec::new() };
+        if rest.is_empty() {
+            self.since = None;
+        }
+        mem::replace(&mut self.items, rest)
+    }
+}
+
+struct State {
+    verify: Queue<VerifyRequest>,
+    verify_recoverable: Queue<VerifyRecoverableRequest>,
+    recover: Queue<RecoverRequest>,
+    shutdown: bool
+}
+
+enum Batch {
+    Verify(Vec<VerifyRequest>),
+    VerifyRecoverable(Vec<VerifyRecoverableRequest>),
+    Recover(Vec<RecoverRequest>)
+}
+
+struct Shared {
+    secp: Secp256k1,
+    config: ServiceConfig,
+    state: Mutex<State>,
+    work: Condvar
+}
+
+impl Shared {
+    // Takes the next batch which is due, or returns the earliest deadline
+    fn next_batch(&self, state: &mut State, now: Instant) -> Result<Batch, Option<Instant>> {
+        let config = &self.config;
+        let flush = state.shutdown;
+        if state.recover.ready(config, now, flush) {
+            return Ok(Batch::Recover(state.recover.take(config.max_batch)));
+        }
+        if state.verify_recoverable.ready(config, now, flush) {
+            return Ok(Batch::VerifyRecoverable(state.verify_recoverable.take(config.max_batch)));
+        }
+        if state.verify.ready(config, now, flush) {
+            return Ok(Batch::Verify(state.verify.take(config.max_batch)));
+        }
+        let deadlines = [state.recover.deadline(config), state.verify_recoverable.deadline(config),
+                         state.verify.deadline(config)];
+        Err(deadlines.iter().filter_map(|&d| d).min())
+    }
+
+    fn worker(&self) {
+        let mut state = self.state.lock().unwrap();
+        loop {
+            let now = Instant::now();
+            match self.next_batch(&mut state, now) {
+                Ok(batch) => {
+                    // Wake another worker if more batches are due
+                    self.work.notify_one();
+                    drop(state);
+                    // A panicking batch fails its own requests, and the
+                    // worker goes on with the next one
+                    let _ = panic::catch_unwind(panic::AssertUnwindSafe(|| self.run(batch)));
+                    state = self.state.lock().unwrap();
+                }
+                Err(_) if state.shutdown => return,
+                Err(Some(deadline)) => {
+                    let timeout = if deadline > now { deadline - now } else { Duration::from_millis(0) };
+                    state = self.work.wait_timeout(state, timeout).unwrap().0;
+                }
+                Err(None) => state = self.work.wait(state).unwrap()
+            }
+        }
+    }
+
+    fn run(&self, batch: Batch) {
+        match batch {
+            Batch::Verify(requests) => {
+                let mut pending = Pending::new(&requests);
+                for &(ref input, _) in &requests {
+                    pending.resolve(self.secp.verify(&input.0, &input.1, &input.2));
+                }
+            }
+            Batch::VerifyRecoverable(requests) => {
+                let mut pending = Pending::new(&requests);
+                let input: Vec<_> = requests.iter().map(|r| r.0).collect();
+                let mut output = vec![Ok(()); input.len()];
+                if let Err(e) = self.secp.verify_batch_each(&input, &mut output) {
+                    output = vec![Err(e); input.len()];
+                }
+                for res in output {
+                    pending.resolve(res);
+                }
+            }
+            Batch::Recover(requests) => {
+                let mut pending = Pending::new(&requests);
+                let input: Vec<_> = requests.iter().map(|r| r.0).collect();
+                let mut output = vec![Err(Error::InvalidSignature); input.len()];
+                if let Err(e) = self.secp.recover_batch(&input, &mut output) {
+                    output = vec![Err(e); input.len()];
+                }
+                for res in output {
+                    pending.resolve(res);
+                }
+            }
+        }
+    }
+}
+
+/// A pool of worker threads running verification and recovery requests in
+/// batches. Requests return at once with a `Response`, which resolves when
+/// the batch holding the request has run. Requests of one kind are
+/// coalesced until `ServiceConfig::max_batch` of them are queued or the
+/// oldest has waited for `ServiceConfig::max_delay`, and each batch runs on
+/// one worker. Batches of `recover` and `verify_recoverable` requests go
+/// through the batch engines (`Secp256k1::recover_batch` and
+/// `Secp256k1::verify_batch_each`), which share work across the batch.
+/// Standard signatures have no such batch check, so `verify` requests are
+/// only moved off the caller's thread and verified one by one. Either way,
+/// the results equal those of the corresponding single calls on the
+/// service's context.
+///
+/// Dropping the service runs the requests still queued and then joins the
+/// workers, so every `Response` resolves. If a batch panics, its requests
+/// fail: waiting for or polling their `Response`s panics in turn, and the
+/// worker goes on with the next batch.
+pub struct VerifyService {
+    shared: Arc<Shared>,
+    workers: Vec<thread::JoinHandle<()>>
+}
+
+impl VerifyService {
+    /// Starts a service running requests on `secp`, which needs to be
+    /// verify-capable (otherwise every request fails with
+    /// `IncapableContext`)
+    pub fn new(secp: Secp256k1, config: ServiceConfig) -> VerifyService {
+        let config = ServiceConfig { max_batch: cmp::max(1, config.max_batch), ..config };
+        let threads = if config.threads == 0 {
+            thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+        } else {
+            config.threads
+        };
+
+        let shared = Arc::new(Shared {
+            secp: secp,
+            config: config,
+            state: Mutex::new(State {
+                verify: Queue::new(),
+                verify_recoverable: Queue::new(),
+                recover: Queue::new(),
+                shutdown: false
+            }),
+            work: Condvar::new()
+        });
+        let workers = (0..threads).map(|i| {
+            let shared = shared.clone();
+            thread::Builder::new()
+                .name(format!("secp256k1-verify-{}", i))
+                .spawn(move || shared.worker())
+                .expect("failed to spawn a verification worker")
+        }).collect();
+        VerifyService { shared: shared, workers: workers }
+    }
+
+    /// The configuration of the service
+    pub fn config(&self) -> &ServiceConfig {
+        &self.shared.config
+    }
+
+    fn submit<F>(&self, push: F)
+        where F: FnOnce(&mut State) -> bool
+    {
+        let mut state = self.shared.state.lock().unwrap();
+        if push(&mut state) {
+            // A new deadline, or a full batch
+            drop(state);
+            self.shared.work.notify_one();
+        }
+    }
+
+    /// Queues `Secp256k1::verify(msg, sig, pk)`. These requests are verified
+    /// one by one on the workers, with no batching gain; use
+    /// `verify_recoverable` where the recovery id is known.
+    pub fn verify(&self, msg: Message, sig: Signature, pk: PublicKey) -> Response<Result<(), Error>> {
+        let slot = Slot::new();
+        let max = self.shared.config.max_batch;
+        let request = ((msg, sig, pk), slot.clone());
+        self.submit(|state| state.verify.push(request) || state.verify.items.len() == max);
+        Response { slot: slot }
+    }
+
+    /// Queues a check that `sig` recovers to `pk`, with the rules of
+    /// `Secp256k1::verify_batch`. These requests run through the batch
+    /// check, which is cheaper per signature than `verify`.
+    pub fn verify_recoverable(&self, msg: Message, sig: RecoverableSignature, pk: PublicKey)
+                              -> Response<Result<(), Error>> {
+        let slot = Slot::new();
+        let max = self.shared.config.max_batch;
+        let request = ((msg, sig, pk), slot.clone());
+        self.submit(|state| state.verify_recoverable.push(request) || state.verify_recoverable.items.len() == max);
+        Response { slot: slot }
+    }
+
+    /// Queues `Secp256k1::recover(msg, sig)`
+    pub fn recover(&self, msg: Message, sig: RecoverableSignature) -> Response<Result<PublicKey, Error>> {
+        let slot = Slot::new();
+        let max = self.shared.config.max_batch;
+        let request = ((msg, sig), slot.clone());
+        self.submit(|state| state.recover.push(request) || state.recover.items.len() == max);
+        Response { slot: slot }
+    }
+}
+
+impl Drop for VerifyService {
+    fn drop(&mut self) {
+        self.shared.state.lock().unwrap().shutdown = true;
+        self.shared.work.notify_all();
+        for worker in self.workers.drain(..) {
+            let _ = worker.join();
+        }
+    }
+}
+
+impl fmt::Debug for VerifyService {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "VerifyService {{ config: {:?}, threads: {} }}", self.shared.config, self.workers.len())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::future::Future;
+    use std::pin::Pin;
+    use std::sync::Arc;
+    use std::task::{Context, Poll, Wake, Waker};
+    use std::thread::{self, Thread};
+    use std::time::{Duration, Instant};
+
+    use rand::thread_rng;
+
+    use super::super::{Secp256k1, ContextFlag};
+    use super::super::Error::{IncapableContext, IncorrectSignature};
+    use super::super::tests::random_message;
+    use super::{VerifyService, ServiceConfig, Slot, Response, Pending};
+
+    struct Unpark(Thread);
+
+    impl Wake for Unpark {
+        fn wake(self: Arc<Self>) {
+            self.0.unpark();
+        }
+    }
+
+    // A minimal executor for a single future
+    fn block_on<F: Future>(mut future: F) -> F::Output {
+        let waker = Waker::from(Arc::new(Unpark(thread::current())));
+        let mut cx = Context::from_waker(&waker);
+        let mut future = unsafe { Pin::new_unchecked(&mut future) };
+        loop {
+            match future.as_mut().poll(&mut cx) {
+                Poll::Ready(value) => return value,
+                Poll::Pending => thread::park()
+            }
+        }
+    }
+
+    #[test]
+    fn service_results() {
+        let s = Secp256k1::new();
+        let service = VerifyService::new(s.clone(), ServiceConfig { max_batch: 16, threads: 3, ..Default::default() });
+
+        let mut requests = Vec::new();
+        for i in 0..100 {
+            let msg = random_message();
+            let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+            let sigr = s.sign_recoverable(&msg, &sk).unwrap();
+            let other = if i % 9 == 4 { random_message() } else { msg };
+            requests.push((service.verify(other, sigr.to_standard(&s), pk),
+                           service.verify_recoverable(other, sigr, pk),
+                           service.recover(other, sigr),
+                           s.recover(&other, &sigr), other == msg));
+        }
+        for (verify, verify_recoverable, recover, expected, good) in requests {
+            let expected_verify = if good { Ok(()) } else { Err(IncorrectSignature) };
+            assert_eq!(verify.wait(), expected_verify);
+            assert_eq!(block_on(verify_recoverable), expected_verify);
+            assert_eq!(recover.wait(), expected);
+        }
+    }
+
+    #[test]
+    fn service_failed_batch() {
+        let requests: Vec<_> = (0..3).map(|_| ((), Slot::<Result<(), ()>>::new())).collect();
+        let responses: Vec<_> = requests.iter().map(|r| Response { slot: r.1.clone() }).collect();
+        {
+            let mut pending = Pending::new(&requests);
+            pending.resolve(Ok(()));
+        }
+        let mut responses = responses.into_iter();
+        assert_eq!(responses.next().unwrap().wait(), Ok(()));
+        for response in responses {
+            assert!(thread::spawn(move || response.wait()).join().is_err());
+        }
+    }
+
+    #[test]
+    fn service_deadline_and_drop() {
+        let s = Secp256k1::new();
+        let msg = random_message();
+        let (sk, pk) = s.generate_keypair(&mut thread_rng()).unwrap();
+        let sig = s.sign(&msg, &sk).unwrap();
+
+        // A lone request runs after `max_delay` without its batch filling up
+        let config = ServiceConfig { max_batch: 1000, max_delay: Duration::from_millis(20), threads: 1 };
+        let service = VerifyService::new(s.clone(), config);
+        let start = Instant::now();
+        assert_eq!(block_on(service.verify(msg, sig, pk)), Ok(()));
+        assert!(start.elapsed() >= Duration::from_millis(20));
+
+        // Queued requests are run when the service is dropped
+        let config = ServiceConfig { max_delay: Duration::from_secs(3600), ..config };
+        let service = VerifyService::new(s.clone(), config);
+        let responses: Vec<_> = (0..10).map(|_| service.verify(msg, sig, pk)).collect();
+        drop(service);
+        for response in responses {
+            assert_eq!(response.wait(), Ok(()));
+        }
+
+        let service = VerifyService::new(Secp256k1::with_caps(ContextFlag::SignOnly), Default::default());
+        let sigr = s.sign_recoverable(&msg, &sk).unwrap();
+        assert_eq!(service.recover(msg, sigr).wait(), Err(IncapableContext));
+        assert_eq!(service.verify_recoverable(msg, sigr, pk).wait(), Err(IncapableContext));
+    }
+}
@@ -0,0 +1,182 @@
+// Bitcoin secp256k1 bindings
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Signing sessions
+//! Repeated signing with one secret key
+//!
+
+use std::{fmt, ptr};
+use std::os::raw::{c_int, c_uchar};
+
+use super::{Secp256k1, ContextFlag, Message, Signature, RecoverableSignature};
+use super::Error::{self, IncapableContext, InvalidSecretKey};
+use key::SecretKey;
+use ffi;
+
+/// A secret key prepared for signing many messages. Signatures are identical
+/// to those of `Secp256k1::sign` and `Secp256k1::sign_recoverable`, but the
+/// message-independent part of the RFC6979 nonce derivation is done once,
+/// and the batch methods share the affine conversion of the nonce points and
+/// the inversion of the nonces across each `ffi::SECP256K1_EXT_BATCH_MAX`
+/// messages. The session state is zeroed when it is dropped.
+pub struct SigningSession<'a> {
+    secp: &'a Secp256k1,
+    state: [u64; ffi::SECP256K1_EXT_SIGNING_SESSION_SIZE / 8]
+}
+
+impl<'a> SigningSession<'a> {
+    /// Prepares a session for signing with `sk`. Requires a signing-capable
+    /// context.
+    pub fn new(secp: &'a Secp256k1, sk: &SecretKey) -> Result<SigningSession<'a>, Error> {
+        if secp.caps == ContextFlag::VerifyOnly || secp.caps == ContextFlag::None {
+            return Err(IncapableContext);
+        }
+
+        let mut session = SigningSession {
+            secp: secp,
+            state: [0; ffi::SECP256K1_EXT_SIGNING_SESSION_SIZE / 8]
+        };
+        unsafe {
+            if ffi::secp256k1_ext_signing_session_init(secp.ctx, session.as_mut_ptr(), sk.as_ptr()) != 1 {
+                return Err(InvalidSecretKey);
+            }
+        }
+        Ok(session)
+    }
+
+    /// Constructs a signature for `msg`, equal to `Secp256k1::sign`
+    pub fn sign(&self, msg: &Message) -> Signature {
+        let mut sig = [ffi::Signature::new()];
+        self.sign_into(&[*msg], &mut sig, ffi::secp256k1_ext_ecdsa_sign_batch_standard);
+        Signature::from(sig[0])
+    }
+
+    /// Constructs a recoverable signature for `msg`, equal to
+    /// `Secp256k1::sign_recoverable`
+    pub fn sign_recoverable(&self, msg: &Message) -> RecoverableSignature {
+        let mut sig = [ffi::RecoverableSignature::new()];
+        self.sign_into(&[*msg], &mut sig, ffi::secp256k1_ext_ecdsa_sign_batch);
+        RecoverableSignature::from(sig[0])
+    }
+
+    /// Signs every message of `msgs`, equal to calling `sign` on each
+    pub fn sign_batch(&self, msgs: &[Message]) -> Vec<Signature> {
+        let mut sigs = vec![ffi::Signature::new(); msgs.len()];
+        self.sign_into(msgs, &mut sigs, ffi::secp256k1_ext_ecdsa_sign_batch_standard);
+        sigs.into_iter().map(Signature::from).collect()
+    }
+
+    /// Signs every message of `msgs`, equal to calling `sign_recoverable` on
+    /// each
+    pub fn sign_recoverable_batch(&self, msgs: &[Message]) -> Vec<RecoverableSignature> {
+        let mut sigs = vec![ffi::RecoverableSignature::new(); msgs.len()];
+        self.sign_into(msgs, &mut sigs, ffi::secp256k1_ext_ecdsa_sign_batch);
+        sigs.into_iter().map(RecoverableSignature::from).collect()
+    }
+
+    // Signs `msgs` into `sigs` with `sign_batch`, one of the batch signing
+    // functions, in chunks of at most `ffi::SECP256K1_EXT_BATCH_MAX`
+    fn sign_into<T>(&self, msgs: &[Message], sigs: &mut [T],
+                    sign_batch: unsafe extern "C" fn(*const ffi::Context, *mut T, *const ffi::SigningSession,
+                                                     *const *const c_uchar, usize) -> c_int) {
+        metrics_timer!(self.secp, Sign, msgs.len());
+        metrics_span!("sign_batch", msgs.len());
+        const BATCH: usize = ffi::SECP256K1_EXT_BATCH_MAX;
+        let mut ptrs: [*const u8; BATCH] = [ptr::null(); BATCH];
+
+        for (msgs, sigs) in msgs.chunks(BATCH).zip(sigs.chunks_mut(BATCH)) {
+            for (i, msg) in msgs.iter().enumerate() {
+                ptrs[i] = msg.as_ptr();
+            }
+            unsafe {
+                // We can assume the return value because it's not possible to construct
+                // an invalid signature from a valid `Message` and `SecretKey`
+                assert_eq!(sign_batch(self.secp.ctx, sigs.as_mut_ptr(), self.as_ptr(),
+                                      ptrs.as_ptr(), msgs.len()), 1);
+            }
+        }
+    }
+
+    /// Obtains a raw pointer suitable for use with FFI functions
+    #[inline]
+    pub fn as_ptr(&self) -> *const ffi::SigningSession {
+        self.state.as_ptr() as *const _
+    }
+
+    /// Obtains a raw mutable pointer suitable for use with FFI functions
+    #[inline]
+    pub fn as_mut_ptr(&mut self) -> *mut ffi::SigningSession {
+        self.state.as_mut_ptr() as *mut _
+    }
+}
+
+impl<'a> Drop for SigningSession<'a> {
+    fn drop(&mut self) {
+        // Volatile, so that the clearing of key material is not optimized out
+        for word in self.state.iter_mut() {
+            unsafe { ptr::write_volatile(word, 0) };
+        }
+    }
+}
+
+impl<'a> fmt::Debug for SigningSession<'a> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "SigningSession(..)")
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use rand::thread_rng;
+
+    use super::super::{Secp256k1, ContextFlag};
+    use super::super::Error::IncapableContext;
+    use super::super::tests::random_message;
+    use key::SecretKey;
+    use super::SigningSession;
+
+    #[test]
+    fn session_matches_sign() {
+        let s = Secp256k1::new();
+
+        for _ in 0..4 {
+            let (sk, _) = s.generate_keypair(&mut thread_rng()).unwrap();
+            let session = SigningSession::new(&s, &sk).unwrap();
+            let msgs: Vec<_> = (0..(2 * ::ffi::SECP256K1_EXT_BATCH_MAX + 5)).map(|_| random_message()).collect();
+
+            let sigs = session.sign_batch(&msgs);
+            let sigrs = session.sign_recoverable_batch(&msgs);
+            assert_eq!(sigs.len(), msgs.len());
+            for (i, msg) in msgs.iter().enumerate() {
+                assert_eq!(sigs[i], s.sign(msg, &sk).unwrap());
+                assert_eq!(sigrs[i], s.sign_recoverable(msg, &sk).unwrap());
+            }
+            assert_eq!(session.sign(&msgs[0]), sigs[0]);
+            assert_eq!(session.sign_recoverable(&msgs[1]), sigrs[1]);
+        }
+        let session = SigningSession::new(&s, &SecretKey::new(&s, &mut thread_rng())).unwrap();
+        assert!(session.sign_batch(&[]).is_empty());
+    }
+
+    #[test]
+    fn session_capabilities() {
+        let s = Secp256k1::new();
+        let sk = SecretKey::new(&s, &mut thread_rng());
+        let vrfy = Secp256k1::with_caps(ContextFlag::VerifyOnly);
+        assert_eq!(SigningSession::new(&vrfy, &sk).unwrap_err(), IncapableContext);
+
+        let sign = Secp256k1::with_caps(ContextFlag::SignOnly);
+        let msg = random_message();
+        assert_eq!(SigningSession::new(&sign, &sk).unwrap().sign_recoverable(&msg),
+                   s.sign_recoverable(&msg, &sk).unwrap());
+    }
+}